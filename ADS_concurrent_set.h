@@ -0,0 +1,153 @@
+#ifndef ADS_CONCURRENT_SET_H
+#define ADS_CONCURRENT_SET_H
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <optional>
+#include <cstdint>
+
+#include "ADS_set.h"
+
+/*
+  ADS_concurrent_set is a lock-striped set for many threads inserting and looking up at the same time.
+
+  Layout:
+  1. The hash space is split into Stripes stripes (a power of two). A stripe is chosen by the top bits of the
+     hash times a constant which none of the engines uses, so the keys of a stripe still spread over all boxes
+     of its table.
+  2. Every stripe owns a complete Set (ADS_set or any engine with the same interface) and a shared_mutex,
+     together on their own cache lines so stripes don't slow each other down by false sharing.
+  3. insert()/erase() lock only the stripe of the key exclusively, count()/find() lock it shared.
+     A stripe grows on its own, under its own lock, while the other stripes keep working.
+  4. Operations touching all stripes (size(), clear(), for_each()) lock the stripes one after another,
+     so they see a consistent stripe at a time, not a snapshot of the whole set.
+
+  Iterators into the stripes would outlive the locks, so find() returns a copy of the stored key and for_each()
+  hands every key to a function while its stripe is locked.
+*/
+template<typename Key, typename Set = ADS_set<Key>, size_t Stripes = 64>
+class ADS_concurrent_set {
+    static_assert(Stripes > 0 && (Stripes & (Stripes - 1)) == 0, "Stripes has to be a power of two");
+
+public:
+    using value_type = Key;
+    using key_type = Key;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_equal = typename Set::key_equal;
+    using hasher = typename Set::hasher;
+    using set_type = Set;
+
+private:
+    struct alignas(64) Stripe {
+        mutable std::shared_mutex lock;
+        Set set;
+    };
+
+    std::unique_ptr<Stripe[]> stripes{new Stripe[Stripes]};
+
+    static constexpr unsigned stripe_bits = static_cast<unsigned>(__builtin_ctzll(Stripes));
+
+//  Stripe of a key, top bits of its hash times a multiplier the engines don't use
+    static size_type stripe_of(const key_type &key) {
+        if constexpr (Stripes == 1) {
+            return 0;
+        } else {
+            std::uint64_t x = static_cast<std::uint64_t>(hasher{}(key)) * 0xD6E8FEB86659FD93ULL;
+            return static_cast<size_type>(x >> (64 - stripe_bits));
+        }
+    }
+
+public:
+    ADS_concurrent_set() = default;
+
+    ADS_concurrent_set(std::initializer_list<key_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    template<typename InputIt>
+    ADS_concurrent_set(InputIt first, InputIt last) { insert(first, last); }
+
+    ADS_concurrent_set(const ADS_concurrent_set &) = delete;
+
+    ADS_concurrent_set &operator=(const ADS_concurrent_set &) = delete;
+
+//  Returns true if key was inserted, false if it was there already
+    bool insert(const key_type &key) {
+        Stripe &stripe = stripes[stripe_of(key)];
+        std::unique_lock<std::shared_mutex> guard{stripe.lock};
+        return stripe.set.insert(key).second;
+    }
+
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (auto it{first}; it != last; ++it) {
+            insert(*it);
+        }
+    }
+
+    size_type erase(const key_type &key) {
+        Stripe &stripe = stripes[stripe_of(key)];
+        std::unique_lock<std::shared_mutex> guard{stripe.lock};
+        return stripe.set.erase(key);
+    }
+
+    size_type count(const key_type &key) const {
+        const Stripe &stripe = stripes[stripe_of(key)];
+        std::shared_lock<std::shared_mutex> guard{stripe.lock};
+        return stripe.set.count(key);
+    }
+
+//  Copy of the stored key equal to key, if there is one
+    std::optional<key_type> find(const key_type &key) const {
+        const Stripe &stripe = stripes[stripe_of(key)];
+        std::shared_lock<std::shared_mutex> guard{stripe.lock};
+        auto it = stripe.set.find(key);
+        if (it == stripe.set.end()) {
+            return std::nullopt;
+        }
+        return *it;
+    }
+
+    size_type size() const {
+        size_type total{0};
+        for (size_type s = 0; s < Stripes; ++s) {
+            std::shared_lock<std::shared_mutex> guard{stripes[s].lock};
+            total += stripes[s].set.size();
+        }
+        return total;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    void clear() {
+        for (size_type s = 0; s < Stripes; ++s) {
+            std::unique_lock<std::shared_mutex> guard{stripes[s].lock};
+            stripes[s].set.clear();
+        }
+    }
+
+//  Calls fn(key) for every key, each stripe is locked shared while its keys are visited
+    template<typename Fn>
+    void for_each(Fn fn) const {
+        for (size_type s = 0; s < Stripes; ++s) {
+            std::shared_lock<std::shared_mutex> guard{stripes[s].lock};
+            for (const auto &key: stripes[s].set) {
+                fn(key);
+            }
+        }
+    }
+
+    void dump(std::ostream &o = std::cerr) const {
+        for (size_type s = 0; s < Stripes; ++s) {
+            std::shared_lock<std::shared_mutex> guard{stripes[s].lock};
+            o << "== stripe " << s << "\n";
+            stripes[s].set.dump(o);
+        }
+    }
+};
+
+#endif // ADS_CONCURRENT_SET_H
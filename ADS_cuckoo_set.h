@@ -0,0 +1,621 @@
+#ifndef ADS_CUCKOO_SET_H
+#define ADS_CUCKOO_SET_H
+
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <new>
+#include <vector>
+#include <cstdint>
+
+#include "ADS_hash_mix.h"
+
+/*
+  ADS_cuckoo_set is a bucketized cuckoo hash set with the same public interface as ADS_set.
+  Every key lives in one of its two buckets or in the stash, so a lookup reads at most two buckets, plus the stash
+  (one more bucket of at most stash_slots keys) while it is not empty.
+
+  Layout:
+  1. Bucket - bucket_slots keys (as many as fit into 64 bytes next to the bitmask, at most 15, at least 1) and a
+     bitmask of the used slots. A bucket is one cache line unless a single key is bigger than that, so keys of more
+     than 31 bytes get buckets of one slot and the table fills up less before it grows.
+  2. The two buckets of a key come from two different mixes of its hash and the seed of the table, a new seed
+     spreads the keys differently at the same table size.
+  3. If both buckets are full, insert() moves a key of one of them to its other bucket, which may move
+     another key, up to max_kicks times (random walk).
+  4. If the walk fails while the table is less than half full, the homeless key goes to the stash, the bucket
+     behind the last one, which holds at most stash_slots keys. If the stash is full too, the table is rebuilt
+     with a new seed, or doubled if it is at least half full.
+  5. Keys with identical hashes share both buckets whatever the seed, so at most 2 * bucket_slots + stash_slots
+     of them fit. insert() throws std::length_error for one more.
+*/
+template<typename Key, size_t N = 7>
+class ADS_cuckoo_set {
+public:
+    class Iterator;
+
+    using value_type = Key;
+    using key_type = Key;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_iterator = Iterator;
+    using iterator = const_iterator;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+
+private:
+    using mask_t = std::uint16_t;
+
+    static constexpr size_type line_size = 64;
+    static constexpr size_type bucket_slots = std::min<size_type>(15, sizeof(key_type) + sizeof(mask_t) < line_size
+                                                                      ? (line_size - sizeof(mask_t)) / sizeof(key_type)
+                                                                      : 1);
+    static constexpr size_type max_kicks = 500;
+    static constexpr size_type stash_slots = std::min<size_type>(bucket_slots, 8);
+
+    struct alignas(line_size) Bucket {
+        alignas(key_type) unsigned char storage[bucket_slots * sizeof(key_type)]; // only used slots are constructed
+        mask_t used{0};
+
+        key_type *keys() { return std::launder(reinterpret_cast<key_type *>(storage)); }
+
+        const key_type *keys() const { return std::launder(reinterpret_cast<const key_type *>(storage)); }
+    };
+    static_assert(sizeof(Bucket) == line_size || bucket_slots == 1, "ADS_cuckoo_set: a Bucket is one cache line");
+
+//  Table of bucket_count buckets (a power of two) followed by the stash bucket
+    Bucket *table{nullptr};
+
+    size_type bucket_count{0};
+
+//  Number of keys in table and stash
+    size_type current_size{0};
+
+//  Number of keys in the stash, lookups don't touch it while it is 0
+    size_type stashed{0};
+
+//  Mixed into the hash of every key before its buckets are taken, a rebuild with another seed moves the keys
+    std::uint64_t seed{0};
+
+//  State of the xorshift generator choosing the slots of the random walk and the seeds
+    std::uint32_t walk_state{2463534242U};
+
+    std::uint32_t next_random() {
+        walk_state ^= walk_state << 13;
+        walk_state ^= walk_state >> 17;
+        walk_state ^= walk_state << 5;
+        return walk_state;
+    }
+
+//  The buckets of a key come from two independent mixes (see ADS_hash_mix.h) of its hash and the seed
+    size_type first_bucket(size_type hash) const { return ADS_mix(hash ^ seed) & (bucket_count - 1); }
+
+    size_type second_bucket(size_type hash) const { return ADS_mix2(hash ^ seed) & (bucket_count - 1); }
+
+    Bucket &stash() const { return table[bucket_count]; }
+
+//  Slot (bucket * bucket_slots + slot) of key in the table or the stash, all_slots() if it is not there.
+//  hash is the hash of key (not mixed)
+    size_type locate(const key_type &key, size_type hash) const;
+
+//  Slots of the buckets, and of the table with the stash
+    size_type table_slots() const { return bucket_count * bucket_slots; }
+
+    size_type all_slots() const { return table_slots() + bucket_slots; }
+
+//  Puts key into a free slot of one of its buckets, moving other keys if both are full. Returns false if the
+//  random walk failed, key holds the key which has no place then (not necessarily the one passed in)
+    bool place(key_type &key);
+
+//  Puts key into a free slot of the stash, false if it is full
+    bool place_stash(key_type &key);
+
+//  Puts key into the table or, if the random walk fails in a table less than half full, into the stash.
+//  Otherwise the table is rebuilt, see rehash()
+    void add(key_type key);
+
+//  True if the keys of both buckets of a key with hash hash all have this hash and the stash is full, then no
+//  rebuild can make room for it
+    bool hopeless(size_type hash) const;
+
+//  Allocates empty table with given number of buckets and an empty stash
+    void allocate(size_type buckets);
+
+//  Destroys keys and releases the table
+    void release();
+
+//  Moves all keys of table and stash into keys, which has room for them
+    void take_keys(std::vector<key_type> &keys);
+
+//  Rebuilds the table with at least buckets buckets, the keys of table and stash (and *extra, if given) are moved.
+//  Every try gets a new seed, every second failed try also doubles the table
+    void rehash(size_type buckets, key_type *extra = nullptr);
+
+//  Calls found(slot or all_slots()) for every key of [first, last) in order, see count_many()
+    template<typename ForwardIt, typename Fn>
+    void lookup_many(ForwardIt first, ForwardIt last, Fn found) const;
+
+//  Iterator pointing to slot i of the table or the stash
+    iterator iterator_at(size_type i) const;
+
+//  Number of buckets needed to hold n keys below max load (9/10)
+    static size_type buckets_for(size_type n);
+
+public:
+    ADS_cuckoo_set() { allocate(buckets_for(N)); }
+
+    ADS_cuckoo_set(std::initializer_list<key_type> ilist) : ADS_cuckoo_set{} { insert(ilist); }
+
+    template<typename InputIt>
+    ADS_cuckoo_set(InputIt first, InputIt last): ADS_cuckoo_set() { insert(first, last); }
+
+    ADS_cuckoo_set(const ADS_cuckoo_set &other);
+
+    ~ADS_cuckoo_set() { release(); }
+
+    ADS_cuckoo_set &operator=(const ADS_cuckoo_set &other);
+
+    ADS_cuckoo_set &operator=(std::initializer_list<key_type> ilist);
+
+    size_type size() const { return current_size; }
+
+    bool empty() const { return current_size == 0; }
+
+    void insert(std::initializer_list<key_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    std::pair<iterator, bool> insert(const key_type &key);
+
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last);
+
+    void clear();
+
+    size_type erase(const key_type &key);
+
+    size_type count(const key_type &key) const { return locate(key, hasher{}(key)) != all_slots(); }
+
+    iterator find(const key_type &key) const;
+
+//  Batched count()/find() like ADS_set: both buckets of a key are prefetched 16 keys before it is compared
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt count_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](size_type i) {
+            *out = size_type{i != all_slots()};
+            ++out;
+        });
+        return out;
+    }
+
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](size_type i) {
+            *out = iterator_at(i);
+            ++out;
+        });
+        return out;
+    }
+
+    void swap(ADS_cuckoo_set &other);
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    void dump(std::ostream &o = std::cerr) const;
+
+    friend bool operator==(const ADS_cuckoo_set &lhs, const ADS_cuckoo_set &rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (const auto &elem: lhs) {
+            if (rhs.count(elem) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const ADS_cuckoo_set &lhs, const ADS_cuckoo_set &rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+template<typename Key, size_t N>
+typename ADS_cuckoo_set<Key, N>::size_type ADS_cuckoo_set<Key, N>::buckets_for(size_type n) {
+    size_type buckets{1};
+    while (buckets * bucket_slots * 9 / 10 < n) { // smallest power of two that keeps n below max load
+        buckets *= 2;
+    }
+    return buckets;
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::allocate(size_type buckets) {
+    table = new Bucket[buckets + 1];
+    bucket_count = buckets;
+    current_size = 0;
+    stashed = 0;
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::release() {
+    if (table) {
+        for (size_type b = 0; b <= bucket_count; ++b) { // the stash too
+            for (size_type s = 0; s < bucket_slots; ++s) {
+                if (table[b].used & (mask_t{1} << s)) {
+                    table[b].keys()[s].~key_type();
+                }
+            }
+        }
+        delete[] table;
+        table = nullptr;
+    }
+    bucket_count = 0;
+    current_size = 0;
+    stashed = 0;
+}
+
+template<typename Key, size_t N>
+typename ADS_cuckoo_set<Key, N>::size_type ADS_cuckoo_set<Key, N>::locate(const key_type &key, size_type hash) const {
+    size_type buckets[3] = {first_bucket(hash), second_bucket(hash), bucket_count}; // the only places key can be
+    for (size_type n = 0; n < (stashed ? 3 : 2); ++n) {
+        size_type b = buckets[n];
+        const Bucket &bucket = table[b];
+        for (mask_t m = bucket.used; m; m &= static_cast<mask_t>(m - 1)) {
+            size_type s = static_cast<size_type>(__builtin_ctz(m));
+            if (key_equal{}(bucket.keys()[s], key)) {
+                return b * bucket_slots + s;
+            }
+        }
+    }
+    return all_slots();
+}
+
+template<typename Key, size_t N>
+bool ADS_cuckoo_set<Key, N>::place(key_type &key) {
+    constexpr mask_t full = static_cast<mask_t>((1U << bucket_slots) - 1);
+    size_type from = bucket_count; // bucket key was just thrown out of
+    for (size_type kick = 0; kick <= max_kicks; ++kick) {
+        size_type hash = hasher{}(key);
+        size_type buckets[2] = {first_bucket(hash), second_bucket(hash)};
+        for (size_type b: buckets) {
+            Bucket &bucket = table[b];
+            if (bucket.used != full) { // free slot
+                size_type s = static_cast<size_type>(__builtin_ctz(static_cast<mask_t>(~bucket.used)));
+                ::new(static_cast<void *>(bucket.keys() + s)) key_type(std::move(key));
+                bucket.used = static_cast<mask_t>(bucket.used | (mask_t{1} << s));
+                return true;
+            }
+        }
+        if (kick == max_kicks) {
+            break;
+        }
+        // both buckets are full, a random key of the bucket key didn't come from makes room
+        size_type b = buckets[0] == from ? buckets[1] : buckets[0];
+        size_type s = next_random() % bucket_slots;
+        std::swap(key, table[b].keys()[s]);
+        from = b;
+    }
+    return false;
+}
+
+template<typename Key, size_t N>
+bool ADS_cuckoo_set<Key, N>::place_stash(key_type &key) {
+    constexpr mask_t full = static_cast<mask_t>((1U << stash_slots) - 1);
+    Bucket &bucket = stash();
+    if (bucket.used == full) {
+        return false;
+    }
+    size_type s = static_cast<size_type>(__builtin_ctz(static_cast<mask_t>(~bucket.used)));
+    ::new(static_cast<void *>(bucket.keys() + s)) key_type(std::move(key));
+    bucket.used = static_cast<mask_t>(bucket.used | (mask_t{1} << s));
+    ++stashed;
+    return true;
+}
+
+template<typename Key, size_t N>
+bool ADS_cuckoo_set<Key, N>::hopeless(size_type hash) const {
+    constexpr mask_t full = static_cast<mask_t>((1U << bucket_slots) - 1);
+    if (stashed < stash_slots) {
+        return false;
+    }
+    for (size_type b: {first_bucket(hash), second_bucket(hash)}) {
+        if (table[b].used != full) {
+            return false;
+        }
+        for (size_type s = 0; s < bucket_slots; ++s) {
+            if (hasher{}(table[b].keys()[s]) != hash) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::add(key_type key) {
+    if (hopeless(hasher{}(key))) { // checked before the random walk changes anything
+        throw std::length_error("ADS_cuckoo_set: too many keys with the same hash value");
+    }
+    if (!place(key) && !(current_size * 2 < table_slots() && place_stash(key))) {
+        // the stash is only used while the table has plenty of room, otherwise the table grows
+        rehash(current_size * 2 < table_slots() ? bucket_count : bucket_count * 2, &key);
+    }
+    ++current_size;
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::take_keys(std::vector<key_type> &keys) {
+    for (size_type b = 0; b <= bucket_count; ++b) { // the stash too
+        for (mask_t m = table[b].used; m; m &= static_cast<mask_t>(m - 1)) {
+            key_type &key = table[b].keys()[__builtin_ctz(m)];
+            keys.push_back(std::move(key)); // keys are moved, not copied
+            key.~key_type();
+        }
+        table[b].used = 0;
+    }
+    stashed = 0;
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::rehash(size_type buckets, key_type *extra) {
+    std::vector<key_type> keys;
+    keys.reserve(current_size + 1); // the set is not changed if this throws ...
+    Bucket *fresh = new Bucket[buckets + 1]; // ... or this
+    size_type old_size = current_size;
+    take_keys(keys);
+    if (extra) {
+        keys.push_back(std::move(*extra));
+    }
+    delete[] table;
+    table = fresh;
+    bucket_count = buckets;
+    try {
+        for (size_type tries = 1;; ++tries) {
+            seed = (std::uint64_t{next_random()} << 32) | next_random();
+            while (!keys.empty()) {
+                key_type &key = keys.back();
+                if (!place(key) && !place_stash(key)) { // the homeless key is in keys.back() now
+                    break;
+                }
+                keys.pop_back();
+            }
+            if (keys.empty()) {
+                break;
+            }
+            take_keys(keys); // room for all keys was reserved
+            if (tries % 2 == 0) {
+                Bucket *grown = new Bucket[bucket_count * 2 + 1];
+                delete[] table;
+                table = grown;
+                bucket_count *= 2;
+            }
+        }
+    } catch (...) { // out of memory while growing again, the keys which are not in the table are lost
+        current_size = 0;
+        for (size_type b = 0; b <= bucket_count; ++b) {
+            current_size += static_cast<size_type>(__builtin_popcount(table[b].used));
+        }
+        throw;
+    }
+    current_size = old_size;
+}
+
+template<typename Key, size_t N>
+template<typename ForwardIt, typename Fn>
+void ADS_cuckoo_set<Key, N>::lookup_many(ForwardIt first, ForwardIt last, Fn found) const {
+    constexpr size_type distance = 16;
+    size_type hashes[distance];
+    size_type hashed{0};
+    ForwardIt ahead = first;
+    for (size_type done{0}; first != last; ++first, ++done) {
+        for (; hashed < done + distance && ahead != last; ++ahead, ++hashed) {
+            size_type hash = hasher{}(*ahead);
+            hashes[hashed % distance] = hash;
+            __builtin_prefetch(table + first_bucket(hash));
+            __builtin_prefetch(table + second_bucket(hash));
+        }
+        found(locate(*first, hashes[done % distance]));
+    }
+}
+
+template<typename Key, size_t N>
+typename ADS_cuckoo_set<Key, N>::iterator ADS_cuckoo_set<Key, N>::iterator_at(size_type i) const {
+    if (i != all_slots()) {
+        return iterator(table, all_slots(), i, table[i / bucket_slots].keys() + i % bucket_slots);
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+ADS_cuckoo_set<Key, N>::ADS_cuckoo_set(const ADS_cuckoo_set &other) : seed{other.seed}, walk_state{other.walk_state} {
+    allocate(other.bucket_count);
+    for (size_type b = 0; b <= bucket_count; ++b) { // same number of buckets and seed, so every key keeps its slot
+        for (size_type s = 0; s < bucket_slots; ++s) {
+            if (other.table[b].used & (mask_t{1} << s)) {
+                ::new(static_cast<void *>(table[b].keys() + s)) key_type(other.table[b].keys()[s]);
+                table[b].used = static_cast<mask_t>(table[b].used | (mask_t{1} << s));
+            }
+        }
+    }
+    current_size = other.current_size;
+    stashed = other.stashed;
+}
+
+template<typename Key, size_t N>
+ADS_cuckoo_set<Key, N> &ADS_cuckoo_set<Key, N>::operator=(const ADS_cuckoo_set &other) {
+    if (this != &other) {
+        ADS_cuckoo_set copy{other};
+        swap(copy);
+    }
+    return *this;
+}
+
+template<typename Key, size_t N>
+ADS_cuckoo_set<Key, N> &ADS_cuckoo_set<Key, N>::operator=(std::initializer_list<key_type> ilist) {
+    clear();
+    insert(ilist);
+    return *this;
+}
+
+template<typename Key, size_t N>
+std::pair<typename ADS_cuckoo_set<Key, N>::iterator, bool> ADS_cuckoo_set<Key, N>::insert(const key_type &key) {
+    iterator it = find(key);
+    if (it != end()) {
+        return {it, false};
+    }
+    if (current_size + 1 > table_slots() * 9 / 10) {
+        rehash(bucket_count * 2); // the stash doesn't count
+    }
+    add(key);
+    return {find(key), true}; // the random walk may have moved key after placing it
+}
+
+template<typename Key, size_t N>
+template<typename InputIt>
+void ADS_cuckoo_set<Key, N>::insert(InputIt first, InputIt last) {
+    for (auto it{first}; it != last; ++it) {
+        insert(*it);
+    }
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::clear() {
+    ADS_cuckoo_set buffer;
+    swap(buffer);
+}
+
+template<typename Key, size_t N>
+typename ADS_cuckoo_set<Key, N>::size_type ADS_cuckoo_set<Key, N>::erase(const key_type &key) {
+    size_type i = locate(key, hasher{}(key));
+    if (i != all_slots()) { // a bucket or the stash
+        Bucket &bucket = table[i / bucket_slots];
+        size_type s = i % bucket_slots;
+        bucket.keys()[s].~key_type();
+        bucket.used = static_cast<mask_t>(bucket.used & ~(mask_t{1} << s));
+        --current_size;
+        if (i >= table_slots()) {
+            --stashed;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+template<typename Key, size_t N>
+typename ADS_cuckoo_set<Key, N>::iterator ADS_cuckoo_set<Key, N>::find(const key_type &key) const {
+    return iterator_at(locate(key, hasher{}(key)));
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::swap(ADS_cuckoo_set &other) {
+    std::swap(table, other.table);
+    std::swap(bucket_count, other.bucket_count);
+    std::swap(current_size, other.current_size);
+    std::swap(stashed, other.stashed);
+    std::swap(seed, other.seed);
+    std::swap(walk_state, other.walk_state);
+}
+
+template<typename Key, size_t N>
+typename ADS_cuckoo_set<Key, N>::const_iterator ADS_cuckoo_set<Key, N>::begin() const {
+    for (size_type b = 0; b <= bucket_count; ++b) { // whole empty buckets are skipped, the stash comes last
+        if (table[b].used) {
+            return iterator_at(b * bucket_slots + static_cast<size_type>(__builtin_ctz(table[b].used)));
+        }
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+typename ADS_cuckoo_set<Key, N>::const_iterator ADS_cuckoo_set<Key, N>::end() const {
+    return const_iterator();
+}
+
+template<typename Key, size_t N>
+void ADS_cuckoo_set<Key, N>::dump(std::ostream &o) const {
+    o << "Buckets = " << bucket_count << " x " << bucket_slots << ", Current size = " << current_size
+      << ", Stash = " << stashed << "\n";
+    for (size_type b = 0; b < bucket_count; ++b) {
+        o << b << " :";
+        for (size_type s = 0; s < bucket_slots; ++s) {
+            if (table[b].used & (mask_t{1} << s)) {
+                o << " " << table[b].keys()[s];
+            } else {
+                o << " --";
+            }
+        }
+        o << "\n";
+    }
+    if (stashed) {
+        o << "stash :";
+        for (size_type s = 0; s < stash_slots; ++s) {
+            if (stash().used & (mask_t{1} << s)) {
+                o << " " << stash().keys()[s];
+            }
+        }
+        o << "\n";
+    }
+}
+
+template<typename Key, size_t N>
+class ADS_cuckoo_set<Key, N>::Iterator {
+    const Bucket *table; // the table itself, not the set, so iterators survive swap() and moves of the set
+    size_type slots; // slots of the table and the stash
+    size_type pos; // slot of the table, the stash is behind the last bucket
+    const key_type *key;
+
+    void skip() { // moving to the next used slot, then to end
+        while (pos < slots && !(table[pos / bucket_slots].used & (mask_t{1} << pos % bucket_slots))) {
+            ++pos;
+        }
+        key = pos < slots ? table[pos / bucket_slots].keys() + pos % bucket_slots : nullptr;
+    }
+
+public:
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using pointer = const value_type *;
+    using iterator_category = std::forward_iterator_tag;
+
+    explicit Iterator(const Bucket *table = nullptr, size_type slots = 0, size_type pos = 0,
+                      const key_type *key = nullptr) : table{table}, slots{slots}, pos{pos}, key{key} {}
+
+    reference operator*() const {
+        return *key;
+    }
+
+    pointer operator->() const {
+        return key;
+    }
+
+    Iterator &operator++() {
+        ++pos;
+        skip();
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        auto ret_code{*this};
+        ++*this;
+        return ret_code;
+    }
+
+    friend bool operator==(const Iterator &lhs, const Iterator &rhs) {
+        return lhs.key == rhs.key;
+    }
+
+    friend bool operator!=(const Iterator &lhs, const Iterator &rhs) {
+        return !(lhs.key == rhs.key);
+    }
+};
+
+template<typename Key, size_t N>
+void swap(ADS_cuckoo_set<Key, N> &lhs, ADS_cuckoo_set<Key, N> &rhs) { lhs.swap(rhs); }
+
+#endif // ADS_CUCKOO_SET_H
@@ -0,0 +1,101 @@
+#ifndef ADS_EPOCH_H
+#define ADS_EPOCH_H
+
+#include <stdexcept>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Epoch based reclamation shared by all ADS_rcu_set instances.
+
+  1. epoch - global counter, bumped by writers every time they retire something.
+  2. slots - one per reader thread (claimed on the first read, returned when the thread ends). While a thread is
+     inside a read section its slot holds the epoch it saw on entry, otherwise 0.
+  3. Something retired in epoch e can be freed once every slot is 0 or greater than e: readers which entered
+     later can't reach it any more, because it was unlinked before the epoch was bumped.
+
+  Entering a read section is a load of epoch, a store into the own slot and a fence. Readers never execute an
+  atomic read-modify-write or take a lock (apart from claiming a slot once per thread).
+*/
+class ADS_epoch {
+public:
+    static constexpr size_t max_threads = 256;
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch{0};
+        std::atomic<bool> claimed{false};
+    };
+
+    static std::atomic<std::uint64_t> epoch;
+    static Slot slots[max_threads];
+
+//  Slot of the calling thread and the nesting depth of its read sections
+    struct Reader {
+        Slot *slot{nullptr};
+        unsigned depth{0};
+
+        Reader() {
+            for (Slot &s: slots) {
+                if (!s.claimed.load(std::memory_order_relaxed) && !s.claimed.exchange(true)) {
+                    slot = &s;
+                    return;
+                }
+            }
+            throw std::runtime_error("ADS_epoch: more than max_threads reader threads");
+        }
+
+        ~Reader() { slot->claimed.store(false, std::memory_order_release); }
+    };
+
+    static Reader &reader() {
+        thread_local Reader r;
+        return r;
+    }
+
+public:
+//  Read section, pointers loaded inside stay valid until it ends. Sections nest
+    class Guard {
+        Reader &r;
+
+    public:
+        Guard() : r{reader()} {
+            if (r.depth++ == 0) {
+                r.slot->epoch.store(epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst); // slot is visible before any pointer is read
+            }
+        }
+
+        ~Guard() {
+            if (--r.depth == 0) {
+                r.slot->epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        Guard(const Guard &) = delete;
+
+        Guard &operator=(const Guard &) = delete;
+    };
+
+//  Called by writers after unlinking, returns the epoch the unlinked objects are retired in
+    static std::uint64_t retire() { return epoch.fetch_add(1); }
+
+//  Everything retired in an epoch below the returned one can be freed
+    static std::uint64_t safe_below() {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in Guard
+        std::uint64_t lowest = epoch.load(std::memory_order_relaxed);
+        for (Slot &s: slots) {
+            std::uint64_t e = s.epoch.load(std::memory_order_acquire);
+            if (e != 0 && e < lowest) {
+                lowest = e;
+            }
+        }
+        return lowest;
+    }
+};
+
+inline std::atomic<std::uint64_t> ADS_epoch::epoch{1};
+inline ADS_epoch::Slot ADS_epoch::slots[ADS_epoch::max_threads];
+
+#endif // ADS_EPOCH_H
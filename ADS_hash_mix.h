@@ -0,0 +1,30 @@
+#ifndef ADS_HASH_MIX_H
+#define ADS_HASH_MIX_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Hash mixers shared by the sets. std::hash of integers is the identity, so a hash is mixed before table positions,
+  tag bits or digests are taken from it:
+  1. ADS_mix() - multiply with 2^64 / golden ratio and fold the high bits down. Kept short on purpose, it runs on
+     every lookup, insert and erase
+  2. ADS_mix2() - murmur3 finalizer, for a second position which doesn't depend on the one from ADS_mix()
+     (the second bucket of ADS_cuckoo_set)
+*/
+
+inline size_t ADS_mix(size_t hash) {
+    std::uint64_t x = static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(x ^ (x >> 32));
+}
+
+inline size_t ADS_mix2(size_t hash) {
+    std::uint64_t x = static_cast<std::uint64_t>(hash);
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return static_cast<size_t>(x ^ (x >> 33));
+}
+
+#endif // ADS_HASH_MIX_H
@@ -0,0 +1,501 @@
+#ifndef ADS_LOCKFREE_SET_H
+#define ADS_LOCKFREE_SET_H
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <cstdint>
+
+#include "ADS_set.h"
+#include "ADS_hash_mix.h"
+#include "ADS_epoch.h"
+
+/*
+  ADS_lockfree_set is a lock-free hash set based on split-ordered lists (Shalev/Shavit).
+
+  Layout:
+  1. All keys are in one sorted lock-free linked list (Harris/Michael: an erased node is first marked in the low bit
+     of its next pointer, then unlinked). The list is ordered by the split-order key, the bit reversed hash.
+  2. Bucket b is a pointer to a sentinel node with split-order key reverse(b) somewhere in that list. All keys of
+     bucket b follow its sentinel, so a lookup starts at the sentinel and walks a short stretch of the list.
+  3. Doubling the bucket count is one compare-and-swap of bucket_count. The new buckets are initialized lazily
+     on first use by inserting their sentinel behind the sentinel of their parent bucket (b without its top bit).
+     Growth never moves a node.
+  4. The bucket directory is split into segments of 1, 1, 2, 4, 8, ... buckets which are allocated on demand,
+     so existing buckets never move either.
+  5. Unlinked nodes are freed through the epoch based reclamation shared with ADS_rcu_set (ADS_epoch). Every
+     operation runs inside a read section.
+
+  insert(), erase(), count() and find() are lock-free and can run concurrently. An iterator stays valid until its
+  key is erased; iterating while other threads erase, clear(), copying and destruction are not concurrency safe.
+*/
+template<typename Key, size_t N = 7>
+class ADS_lockfree_set {
+public:
+    class Iterator;
+
+    using value_type = Key;
+    using key_type = Key;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_iterator = Iterator;
+    using iterator = const_iterator;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+
+private:
+//  Sentinels have an even split-order key, nodes holding keys an odd one
+    struct Node {
+        std::uint64_t so_key;
+        std::atomic<Node *> next{nullptr}; // low bit set: this node is erased
+        Node *retired_next{nullptr};
+        std::uint64_t retired_epoch{0};
+
+        explicit Node(std::uint64_t so_key) : so_key{so_key} {}
+
+        bool sentinel() const { return !(so_key & 1); }
+    };
+
+    struct Element : Node {
+        key_type key;
+
+        Element(std::uint64_t so_key, const key_type &key) : Node{so_key}, key{key} {}
+    };
+
+    static constexpr unsigned segment_count = 65;
+
+//  Segment s holds buckets [2^(s-1), 2^s), segment 0 only bucket 0
+    mutable std::atomic<std::atomic<Node *> *> segments[segment_count];
+
+    std::atomic<size_type> bucket_count;
+
+    std::atomic<size_type> current_size{0};
+
+//  Stack of unlinked nodes waiting for the readers, linked by retired_next
+    mutable std::atomic<Node *> retired{nullptr};
+
+    mutable std::atomic<size_type> retired_count{0};
+
+    static std::uint64_t reverse(std::uint64_t x) {
+        x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+        x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+        x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return __builtin_bswap64(x);
+    }
+
+//  Split-order key of a key with the mixed hash (see ADS_mix()), the low bits of the hash become the high bits
+    static std::uint64_t key_order(size_type hash) { return reverse(hash) | 1; }
+
+    static std::uint64_t sentinel_order(size_type bucket) { return reverse(bucket); }
+
+    static bool is_marked(Node *p) { return reinterpret_cast<std::uintptr_t>(p) & 1; }
+
+    static Node *marked(Node *p) { return reinterpret_cast<Node *>(reinterpret_cast<std::uintptr_t>(p) | 1); }
+
+    static Node *unmarked(Node *p) { return reinterpret_cast<Node *>(reinterpret_cast<std::uintptr_t>(p) & ~std::uintptr_t{1}); }
+
+    static void destroy(Node *n) {
+        if (n->sentinel()) {
+            delete n;
+        } else {
+            delete static_cast<Element *>(n);
+        }
+    }
+
+//  Directory entry of bucket b, allocating its segment if needed
+    std::atomic<Node *> &bucket_slot(size_type b) const;
+
+//  Sentinel of bucket b, initializing the bucket (and its parents) if needed
+    Node *bucket(size_type b) const;
+
+//  Walks the list behind start to the place of so_key/key (key == nullptr: the sentinel with so_key). Afterwards
+//  prev is the link pointing to curr, curr the first node not ordered before it. Returns true if curr matches.
+//  Erased nodes met on the way are unlinked
+    bool search(Node *start, std::uint64_t so_key, const key_type *key, std::atomic<Node *> *&prev, Node *&curr) const;
+
+//  Hands an unlinked node to the reclamation, called by the thread whose CAS unlinked it
+    void retire(Node *n) const;
+
+//  Frees retired nodes no thread can reach any more
+    void reclaim() const;
+
+//  Creates bucket 0 with its sentinel
+    void init();
+
+//  Frees all nodes and the directory (no other thread may use the set)
+    void release();
+
+public:
+    ADS_lockfree_set() { init(); }
+
+    ADS_lockfree_set(std::initializer_list<key_type> ilist) : ADS_lockfree_set{} { insert(ilist); }
+
+    template<typename InputIt>
+    ADS_lockfree_set(InputIt first, InputIt last): ADS_lockfree_set() { insert(first, last); }
+
+    ADS_lockfree_set(const ADS_lockfree_set &other) : ADS_lockfree_set{} { insert(other.begin(), other.end()); }
+
+    ~ADS_lockfree_set() { release(); }
+
+    ADS_lockfree_set &operator=(const ADS_lockfree_set &other);
+
+    ADS_lockfree_set &operator=(std::initializer_list<key_type> ilist);
+
+    size_type size() const { return current_size.load(std::memory_order_relaxed); }
+
+    bool empty() const { return size() == 0; }
+
+    void insert(std::initializer_list<key_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    std::pair<iterator, bool> insert(const key_type &key);
+
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (auto it{first}; it != last; ++it) {
+            insert(*it);
+        }
+    }
+
+    void clear();
+
+    size_type erase(const key_type &key);
+
+    size_type count(const key_type &key) const { return find(key) != end(); }
+
+    iterator find(const key_type &key) const;
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    void dump(std::ostream &o = std::cerr) const;
+
+    friend bool operator==(const ADS_lockfree_set &lhs, const ADS_lockfree_set &rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (const auto &elem: lhs) {
+            if (rhs.count(elem) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const ADS_lockfree_set &lhs, const ADS_lockfree_set &rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+template<typename Key, size_t N>
+void ADS_lockfree_set<Key, N>::init() {
+    for (auto &segment: segments) {
+        segment.store(nullptr, std::memory_order_relaxed);
+    }
+    bucket_count.store(ADS_pow2_growth::round_up(N), std::memory_order_relaxed);
+    current_size.store(0, std::memory_order_relaxed);
+    bucket_slot(0).store(new Node{sentinel_order(0)}, std::memory_order_release); // head of the list
+}
+
+template<typename Key, size_t N>
+void ADS_lockfree_set<Key, N>::release() {
+    for (Node *n = bucket_slot(0).load(std::memory_order_relaxed); n;) { // erased but still linked nodes as well
+        Node *next = unmarked(n->next.load(std::memory_order_relaxed));
+        destroy(n);
+        n = next;
+    }
+    for (Node *n = retired.exchange(nullptr); n;) {
+        Node *next = n->retired_next;
+        destroy(n);
+        n = next;
+    }
+    for (auto &segment: segments) {
+        delete[] segment.exchange(nullptr);
+    }
+}
+
+template<typename Key, size_t N>
+std::atomic<typename ADS_lockfree_set<Key, N>::Node *> &ADS_lockfree_set<Key, N>::bucket_slot(size_type b) const {
+    unsigned s = b == 0 ? 0 : 64 - static_cast<unsigned>(__builtin_clzll(b));
+    size_type first = s == 0 ? 0 : size_type{1} << (s - 1);
+    std::atomic<Node *> *segment = segments[s].load(std::memory_order_acquire);
+    if (!segment) {
+        size_type length = s == 0 ? 1 : first;
+        auto *fresh = new std::atomic<Node *>[length];
+        for (size_type i = 0; i < length; ++i) {
+            fresh[i].store(nullptr, std::memory_order_relaxed);
+        }
+        if (segments[s].compare_exchange_strong(segment, fresh, std::memory_order_acq_rel)) {
+            segment = fresh;
+        } else { // another thread was faster, segment holds its allocation now
+            delete[] fresh;
+        }
+    }
+    return segment[b - first];
+}
+
+template<typename Key, size_t N>
+typename ADS_lockfree_set<Key, N>::Node *ADS_lockfree_set<Key, N>::bucket(size_type b) const {
+    std::atomic<Node *> &slot = bucket_slot(b);
+    Node *sentinel = slot.load(std::memory_order_acquire);
+    if (sentinel) {
+        return sentinel;
+    }
+    size_type parent = b & ~(size_type{1} << (63 - __builtin_clzll(b))); // b is never 0 here
+    Node *start = bucket(parent);
+    Node *fresh = new Node{sentinel_order(b)};
+    std::atomic<Node *> *prev;
+    Node *curr;
+    for (;;) {
+        if (search(start, fresh->so_key, nullptr, prev, curr)) { // another thread inserted the sentinel already
+            delete fresh;
+            fresh = curr;
+            break;
+        }
+        fresh->next.store(curr, std::memory_order_relaxed);
+        if (prev->compare_exchange_weak(curr, fresh, std::memory_order_release, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    slot.store(fresh, std::memory_order_release);
+    return fresh;
+}
+
+template<typename Key, size_t N>
+bool ADS_lockfree_set<Key, N>::search(Node *start, std::uint64_t so_key, const key_type *key,
+                                      std::atomic<Node *> *&prev, Node *&curr) const {
+    retry:
+    prev = &start->next;
+    curr = unmarked(prev->load(std::memory_order_acquire));
+    while (curr) {
+        Node *next = curr->next.load(std::memory_order_acquire);
+        if (is_marked(next)) { // curr is erased, unlinking it
+            Node *expected = curr;
+            if (!prev->compare_exchange_strong(expected, unmarked(next), std::memory_order_acq_rel,
+                                               std::memory_order_relaxed)) {
+                goto retry; // prev changed or was erased itself
+            }
+            retire(curr);
+            curr = unmarked(next);
+            continue;
+        }
+        if (curr->so_key > so_key) {
+            return false;
+        }
+        if (curr->so_key == so_key && (!key || key_equal{}(static_cast<Element *>(curr)->key, *key))) {
+            return true;
+        }
+        prev = &curr->next; // equal split-order keys (equal hashes) are checked one by one
+        curr = next;
+    }
+    return false;
+}
+
+template<typename Key, size_t N>
+void ADS_lockfree_set<Key, N>::retire(Node *n) const {
+    n->retired_epoch = ADS_epoch::retire();
+    n->retired_next = retired.load(std::memory_order_relaxed);
+    while (!retired.compare_exchange_weak(n->retired_next, n, std::memory_order_release, std::memory_order_relaxed)) {}
+    if (retired_count.fetch_add(1, std::memory_order_relaxed) % 64 == 63) { // scanning the reader slots pays off for a batch
+        reclaim();
+    }
+}
+
+template<typename Key, size_t N>
+void ADS_lockfree_set<Key, N>::reclaim() const {
+    Node *list = retired.exchange(nullptr, std::memory_order_acquire); // this thread owns the whole stack now
+    std::uint64_t below = ADS_epoch::safe_below();
+    Node *keep{nullptr};
+    Node *keep_last{nullptr};
+    while (list) {
+        Node *next = list->retired_next;
+        if (list->retired_epoch < below) {
+            destroy(list);
+        } else {
+            list->retired_next = keep;
+            keep = list;
+            if (!keep_last) {
+                keep_last = list;
+            }
+        }
+        list = next;
+    }
+    if (keep) { // the rest goes back onto the stack
+        keep_last->retired_next = retired.load(std::memory_order_relaxed);
+        while (!retired.compare_exchange_weak(keep_last->retired_next, keep, std::memory_order_release,
+                                              std::memory_order_relaxed)) {}
+    }
+}
+
+template<typename Key, size_t N>
+ADS_lockfree_set<Key, N> &ADS_lockfree_set<Key, N>::operator=(const ADS_lockfree_set &other) {
+    if (this != &other) {
+        clear();
+        insert(other.begin(), other.end());
+    }
+    return *this;
+}
+
+template<typename Key, size_t N>
+ADS_lockfree_set<Key, N> &ADS_lockfree_set<Key, N>::operator=(std::initializer_list<key_type> ilist) {
+    clear();
+    insert(ilist);
+    return *this;
+}
+
+template<typename Key, size_t N>
+std::pair<typename ADS_lockfree_set<Key, N>::iterator, bool> ADS_lockfree_set<Key, N>::insert(const key_type &key) {
+    size_type hash = ADS_mix(hasher{}(key));
+    std::uint64_t so_key = key_order(hash);
+    Element *element{nullptr};
+    {
+        ADS_epoch::Guard guard;
+        Node *start = bucket(hash & (bucket_count.load(std::memory_order_acquire) - 1));
+        std::atomic<Node *> *prev;
+        Node *curr;
+        for (;;) {
+            if (search(start, so_key, &key, prev, curr)) {
+                delete element;
+                return {iterator(curr), false};
+            }
+            if (!element) { // only built once the key is known to be new
+                element = new Element{so_key, key};
+            }
+            element->next.store(curr, std::memory_order_relaxed);
+            if (prev->compare_exchange_weak(curr, element, std::memory_order_release, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+    }
+    size_type buckets = bucket_count.load(std::memory_order_relaxed);
+    if (current_size.fetch_add(1, std::memory_order_relaxed) + 1 > buckets) { // max load factor 1
+        bucket_count.compare_exchange_strong(buckets, buckets * 2, std::memory_order_release, std::memory_order_relaxed);
+    }
+    return {iterator(element), true};
+}
+
+template<typename Key, size_t N>
+void ADS_lockfree_set<Key, N>::clear() {
+    release();
+    init();
+}
+
+template<typename Key, size_t N>
+typename ADS_lockfree_set<Key, N>::size_type ADS_lockfree_set<Key, N>::erase(const key_type &key) {
+    size_type hash = ADS_mix(hasher{}(key));
+    std::uint64_t so_key = key_order(hash);
+    {
+        ADS_epoch::Guard guard;
+        Node *start = bucket(hash & (bucket_count.load(std::memory_order_acquire) - 1));
+        std::atomic<Node *> *prev;
+        Node *curr;
+        for (;;) {
+            if (!search(start, so_key, &key, prev, curr)) {
+                return 0;
+            }
+            Node *next = curr->next.load(std::memory_order_acquire);
+            if (is_marked(next) || !curr->next.compare_exchange_weak(next, marked(next), std::memory_order_acq_rel,
+                                                                     std::memory_order_relaxed)) {
+                continue; // curr changed meanwhile, searching again
+            }
+            // curr is erased now, whoever unlinks it retires it
+            Node *erased = curr;
+            if (prev->compare_exchange_strong(curr, next, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                retire(erased);
+            } else {
+                search(start, so_key, &key, prev, curr); // unlinks it on the way
+            }
+            break;
+        }
+    }
+    current_size.fetch_sub(1, std::memory_order_relaxed);
+    return 1;
+}
+
+template<typename Key, size_t N>
+typename ADS_lockfree_set<Key, N>::iterator ADS_lockfree_set<Key, N>::find(const key_type &key) const {
+    size_type hash = ADS_mix(hasher{}(key));
+    ADS_epoch::Guard guard;
+    Node *start = bucket(hash & (bucket_count.load(std::memory_order_acquire) - 1));
+    std::atomic<Node *> *prev;
+    Node *curr;
+    if (search(start, key_order(hash), &key, prev, curr)) {
+        return iterator(curr);
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+typename ADS_lockfree_set<Key, N>::const_iterator ADS_lockfree_set<Key, N>::begin() const {
+    return ++const_iterator(bucket_slot(0).load(std::memory_order_acquire)); // the list starts with a sentinel
+}
+
+template<typename Key, size_t N>
+typename ADS_lockfree_set<Key, N>::const_iterator ADS_lockfree_set<Key, N>::end() const {
+    return const_iterator();
+}
+
+template<typename Key, size_t N>
+void ADS_lockfree_set<Key, N>::dump(std::ostream &o) const {
+    o << "Buckets = " << bucket_count.load() << ", Current size = " << size() << "\n";
+    for (Node *n = bucket_slot(0).load(std::memory_order_acquire); n; n = unmarked(n->next.load(std::memory_order_acquire))) {
+        if (n->sentinel()) {
+            o << "[" << reverse(n->so_key) << "]";
+        } else {
+            o << " " << static_cast<Element *>(n)->key;
+        }
+        if (is_marked(n->next.load(std::memory_order_relaxed))) {
+            o << "(erased)";
+        }
+    }
+    o << "\n";
+}
+
+template<typename Key, size_t N>
+class ADS_lockfree_set<Key, N>::Iterator {
+    Node *node;
+
+public:
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using pointer = const value_type *;
+    using iterator_category = std::forward_iterator_tag;
+
+    explicit Iterator(Node *node = nullptr) : node{node} {}
+
+    reference operator*() const {
+        return static_cast<const Element *>(node)->key;
+    }
+
+    pointer operator->() const {
+        return &static_cast<const Element *>(node)->key;
+    }
+
+    Iterator &operator++() { // sentinels and erased nodes are skipped
+        do {
+            node = unmarked(node->next.load(std::memory_order_acquire));
+        } while (node && (node->sentinel() || is_marked(node->next.load(std::memory_order_acquire))));
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        auto ret_code{*this};
+        ++*this;
+        return ret_code;
+    }
+
+    friend bool operator==(const Iterator &lhs, const Iterator &rhs) {
+        return lhs.node == rhs.node;
+    }
+
+    friend bool operator!=(const Iterator &lhs, const Iterator &rhs) {
+        return !(lhs.node == rhs.node);
+    }
+};
+
+#endif // ADS_LOCKFREE_SET_H
@@ -0,0 +1,273 @@
+#ifndef ADS_RCU_SET_H
+#define ADS_RCU_SET_H
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <vector>
+#include <cstdint>
+
+#include "ADS_set.h"
+#include "ADS_epoch.h"
+
+/*
+  ADS_rcu_set is a chained hash set for read-mostly data shared between threads.
+
+  1. count(), find() and for_each() never lock and never write shared memory except the own epoch slot. They
+     walk chains whose nodes are published with release stores and read with acquire loads.
+  2. insert(), erase() and clear() are serialized by a mutex. A new node is linked in front of its chain after
+     it is fully built, erase unlinks a node but leaves its next pointer intact for readers standing on it.
+  3. Growing builds a new table with copies of all keys and publishes it with one release store. Nodes which
+     were erased and old tables with their nodes are freed by the writers once no reader can see them (ADS_epoch).
+*/
+template<typename Key, size_t N = 7>
+class ADS_rcu_set {
+public:
+    using value_type = Key;
+    using key_type = Key;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+
+private:
+    struct Node {
+        key_type key;
+        std::atomic<Node *> next;
+
+        Node(const key_type &key, Node *next) : key{key}, next{next} {}
+    };
+
+    struct Table {
+        size_type table_size;
+        ADS_pow2_growth growth;
+        std::unique_ptr<std::atomic<Node *>[]> heads;
+
+        explicit Table(size_type table_size) : table_size{table_size}, heads{new std::atomic<Node *>[table_size]} {
+            growth.set_size(table_size);
+            for (size_type i = 0; i < table_size; ++i) {
+                heads[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~Table() { // the chains belong to the table
+            for (size_type i = 0; i < table_size; ++i) {
+                for (Node *n = heads[i].load(std::memory_order_relaxed); n;) {
+                    Node *next = n->next.load(std::memory_order_relaxed);
+                    delete n;
+                    n = next;
+                }
+            }
+        }
+
+        std::atomic<Node *> &head(const key_type &key) const { return heads[growth.index(hasher{}(key))]; }
+    };
+
+//  Unlinked node or replaced table waiting for the readers, exactly one of node and table is set
+    struct Retired {
+        std::uint64_t epoch;
+        Node *node;
+        Table *table;
+    };
+
+    std::atomic<Table *> table;
+
+    std::atomic<size_type> current_size{0};
+
+//  Serializes writers, protects retired
+    std::mutex writer;
+
+    std::vector<Retired> retired;
+
+//  Frees retired objects no reader can reach any more, called by writers after retiring
+    void reclaim(bool force = false);
+
+    void retire(Node *node, Table *old_table);
+
+//  Node holding key in the current table, nullptr if there is none. Must be called inside a read section or by
+//  the writer
+    static Node *search(const Table *t, const key_type &key);
+
+//  Replaces the table by one with table_size boxes (writer only)
+    void rehash(size_type table_size);
+
+public:
+    ADS_rcu_set() : table{new Table{ADS_pow2_growth::round_up(N)}} {}
+
+    ADS_rcu_set(std::initializer_list<key_type> ilist) : ADS_rcu_set{} { insert(ilist.begin(), ilist.end()); }
+
+    template<typename InputIt>
+    ADS_rcu_set(InputIt first, InputIt last): ADS_rcu_set() { insert(first, last); }
+
+    ADS_rcu_set(const ADS_rcu_set &) = delete;
+
+    ADS_rcu_set &operator=(const ADS_rcu_set &) = delete;
+
+//  No reader may use the set any more
+    ~ADS_rcu_set();
+
+    size_type size() const { return current_size.load(std::memory_order_relaxed); }
+
+    bool empty() const { return size() == 0; }
+
+//  Returns true if key was inserted, false if it was there already
+    bool insert(const key_type &key);
+
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (auto it{first}; it != last; ++it) {
+            insert(*it);
+        }
+    }
+
+    size_type erase(const key_type &key);
+
+    void clear();
+
+    size_type count(const key_type &key) const {
+        ADS_epoch::Guard guard;
+        return search(table.load(std::memory_order_acquire), key) != nullptr;
+    }
+
+//  Copy of the stored key equal to key, if there is one
+    std::optional<key_type> find(const key_type &key) const {
+        ADS_epoch::Guard guard;
+        if (Node *n = search(table.load(std::memory_order_acquire), key)) {
+            return n->key;
+        }
+        return std::nullopt;
+    }
+
+//  Calls fn(key) for every key of the table current at the call, without locking. Keys inserted or erased
+//  meanwhile may or may not be visited
+    template<typename Fn>
+    void for_each(Fn fn) const {
+        ADS_epoch::Guard guard;
+        const Table *t = table.load(std::memory_order_acquire);
+        for (size_type i = 0; i < t->table_size; ++i) {
+            for (Node *n = t->heads[i].load(std::memory_order_acquire); n; n = n->next.load(std::memory_order_acquire)) {
+                fn(n->key);
+            }
+        }
+    }
+
+    void dump(std::ostream &o = std::cerr) const;
+};
+
+template<typename Key, size_t N>
+ADS_rcu_set<Key, N>::~ADS_rcu_set() {
+    reclaim(true);
+    delete table.load(std::memory_order_relaxed);
+}
+
+template<typename Key, size_t N>
+void ADS_rcu_set<Key, N>::reclaim(bool force) {
+    std::uint64_t below = force ? ~std::uint64_t{0} : ADS_epoch::safe_below();
+    size_type kept{0};
+    for (Retired &r: retired) {
+        if (r.epoch < below) {
+            delete r.node;
+            delete r.table;
+        } else {
+            retired[kept++] = r;
+        }
+    }
+    retired.resize(kept);
+}
+
+template<typename Key, size_t N>
+void ADS_rcu_set<Key, N>::retire(Node *node, Table *old_table) {
+    retired.push_back({ADS_epoch::retire(), node, old_table});
+    if (old_table || retired.size() >= 64) { // scanning the reader slots only pays off for a batch of nodes
+        reclaim();
+    }
+}
+
+template<typename Key, size_t N>
+typename ADS_rcu_set<Key, N>::Node *ADS_rcu_set<Key, N>::search(const Table *t, const key_type &key) {
+    for (Node *n = t->head(key).load(std::memory_order_acquire); n; n = n->next.load(std::memory_order_acquire)) {
+        if (key_equal{}(n->key, key)) {
+            return n;
+        }
+    }
+    return nullptr;
+}
+
+template<typename Key, size_t N>
+void ADS_rcu_set<Key, N>::rehash(size_type table_size) {
+    Table *old_table = table.load(std::memory_order_relaxed);
+    auto new_table = std::make_unique<Table>(table_size);
+    for (size_type i = 0; i < old_table->table_size; ++i) { // readers still walk the old nodes, so keys are copied
+        for (Node *n = old_table->heads[i].load(std::memory_order_relaxed); n;
+             n = n->next.load(std::memory_order_relaxed)) {
+            std::atomic<Node *> &head = new_table->head(n->key);
+            head.store(new Node{n->key, head.load(std::memory_order_relaxed)}, std::memory_order_relaxed);
+        }
+    }
+    table.store(new_table.release(), std::memory_order_release);
+    retire(nullptr, old_table);
+}
+
+template<typename Key, size_t N>
+bool ADS_rcu_set<Key, N>::insert(const key_type &key) {
+    std::lock_guard<std::mutex> lock{writer};
+    Table *t = table.load(std::memory_order_relaxed);
+    if (search(t, key)) {
+        return false;
+    }
+    if (current_size.load(std::memory_order_relaxed) + 1 > t->table_size) { // max load factor 1
+        rehash(t->table_size * 2);
+        t = table.load(std::memory_order_relaxed);
+    }
+    std::atomic<Node *> &head = t->head(key);
+    head.store(new Node{key, head.load(std::memory_order_relaxed)}, std::memory_order_release); // node is complete
+    current_size.store(current_size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename Key, size_t N>
+typename ADS_rcu_set<Key, N>::size_type ADS_rcu_set<Key, N>::erase(const key_type &key) {
+    std::lock_guard<std::mutex> lock{writer};
+    Table *t = table.load(std::memory_order_relaxed);
+    std::atomic<Node *> *link = &t->head(key);
+    for (Node *n = link->load(std::memory_order_relaxed); n; link = &n->next, n = link->load(std::memory_order_relaxed)) {
+        if (key_equal{}(n->key, key)) {
+            link->store(n->next.load(std::memory_order_relaxed), std::memory_order_release); // n->next stays for readers
+            current_size.store(current_size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            retire(n, nullptr);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+template<typename Key, size_t N>
+void ADS_rcu_set<Key, N>::clear() {
+    std::lock_guard<std::mutex> lock{writer};
+    Table *old_table = table.load(std::memory_order_relaxed);
+    table.store(new Table{ADS_pow2_growth::round_up(N)}, std::memory_order_release);
+    current_size.store(0, std::memory_order_relaxed);
+    retire(nullptr, old_table);
+}
+
+template<typename Key, size_t N>
+void ADS_rcu_set<Key, N>::dump(std::ostream &o) const {
+    ADS_epoch::Guard guard;
+    const Table *t = table.load(std::memory_order_acquire);
+    o << "Table size = " << t->table_size << ", Current size = " << size() << "\n";
+    for (size_type i = 0; i < t->table_size; ++i) {
+        o << i << " :";
+        for (Node *n = t->heads[i].load(std::memory_order_acquire); n; n = n->next.load(std::memory_order_acquire)) {
+            o << " " << n->key;
+        }
+        o << "\n";
+    }
+}
+
+#endif // ADS_RCU_SET_H
@@ -0,0 +1,484 @@
+#ifndef ADS_ROBIN_SET_H
+#define ADS_ROBIN_SET_H
+
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+#include "ADS_hash_mix.h"
+
+/*
+  ADS_robin_set is a Robin Hood linear probing alternative to the chaining ADS_set, with the same public interface.
+
+  Layout:
+  1. dist - one byte per slot. 0 marks a free slot, otherwise the slot holds a key whose probe distance
+     (number of slots behind its home slot) is dist - 1. Distances above 253 are stored as dist_saturated
+     and recomputed from the hash when needed.
+  2. slots - flat array of keys, slot i belongs to dist[i]. Keys live only in used slots.
+  3. Insert takes the slot of any key that is closer to its home than the new key would be (robs the rich),
+     so probe distances stay short and even. A lookup stops as soon as it meets a key closer to home than itself.
+  4. Erase shifts the following keys back by one slot until a free slot or a key at its home slot is met,
+     so no tombstones are left behind.
+*/
+template<typename Key, size_t N = 7>
+class ADS_robin_set {
+public:
+    class Iterator;
+
+    using value_type = Key;
+    using key_type = Key;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_iterator = Iterator;
+    using iterator = const_iterator;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+
+private:
+    using dist_t = std::uint8_t;
+
+    static constexpr dist_t dist_free = 0;
+    static constexpr dist_t dist_saturated = 255; // probe distance 254 or more, has to be recomputed
+
+//  Probe distances, one per slot
+    dist_t *dist{nullptr};
+
+//  Flat key storage. Only used slots hold a constructed key
+    key_type *slots{nullptr};
+
+//  Number of slots, a power of two
+    size_type capacity{0};
+
+//  Number of keys in the table
+    size_type current_size{0};
+
+//  Slot where a key with the mixed hash (see ADS_mix()) belongs
+    size_type home(size_type hash) const { return hash & (capacity - 1); }
+
+    static dist_t encode(size_type d) { return d < dist_saturated - 1 ? static_cast<dist_t>(d + 1) : dist_saturated; }
+
+//  Probe distance of the key in used slot i
+    size_type distance(size_type i) const {
+        if (dist[i] != dist_saturated) {
+            return dist[i] - 1u;
+        }
+        return (i - home(ADS_mix(hasher{}(slots[i])))) & (capacity - 1);
+    }
+
+//  Returns slot index of key or capacity if key is not in the table
+    size_type locate(const key_type &key, size_type hash) const;
+
+//  Calls found(slot index or capacity) for every key of [first, last) in order, see count_many()
+    template<typename ForwardIt, typename Fn>
+    void lookup_many(ForwardIt first, ForwardIt last, Fn found) const;
+
+//  Puts key (known not to be in the table) into its probe sequence, returns the slot it ends up in
+    size_type place(key_type key, size_type hash);
+
+//  Allocates empty table with given number of slots
+    void allocate(size_type slot_count);
+
+//  Destroys keys and releases the arrays
+    void release();
+
+//  Rebuilds table with slot_count slots
+    void rehash(size_type slot_count);
+
+//  Number of slots needed to hold n keys below max load (7/8)
+    static size_type slots_for(size_type n);
+
+public:
+    ADS_robin_set() { allocate(slots_for(N)); }
+
+    ADS_robin_set(std::initializer_list<key_type> ilist) : ADS_robin_set{} { insert(ilist); }
+
+    template<typename InputIt>
+    ADS_robin_set(InputIt first, InputIt last): ADS_robin_set() { insert(first, last); }
+
+    ADS_robin_set(const ADS_robin_set &other);
+
+    ~ADS_robin_set() { release(); }
+
+    ADS_robin_set &operator=(const ADS_robin_set &other);
+
+    ADS_robin_set &operator=(std::initializer_list<key_type> ilist);
+
+    size_type size() const { return current_size; }
+
+    bool empty() const { return current_size == 0; }
+
+    void insert(std::initializer_list<key_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    std::pair<iterator, bool> insert(const key_type &key);
+
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last);
+
+    void clear();
+
+//  Backward-shift deletion: the keys behind the erased one move one slot closer to home
+    size_type erase(const key_type &key);
+
+    size_type count(const key_type &key) const {
+        return locate(key, ADS_mix(hasher{}(key))) != capacity;
+    }
+
+    iterator find(const key_type &key) const;
+
+//  Batched count()/find() like ADS_set: a group of 16 keys is hashed and their home slots are prefetched
+//  before the first key is compared
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt count_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](size_type i) {
+            *out = size_type{i != capacity};
+            ++out;
+        });
+        return out;
+    }
+
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](size_type i) {
+            *out = i != capacity ? iterator(dist + i, slots + i, dist + capacity) : end();
+            ++out;
+        });
+        return out;
+    }
+
+    void swap(ADS_robin_set &other);
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    void dump(std::ostream &o = std::cerr) const;
+
+    friend bool operator==(const ADS_robin_set &lhs, const ADS_robin_set &rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (const auto &elem: lhs) {
+            if (rhs.count(elem) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const ADS_robin_set &lhs, const ADS_robin_set &rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+template<typename Key, size_t N>
+typename ADS_robin_set<Key, N>::size_type ADS_robin_set<Key, N>::slots_for(size_type n) {
+    size_type slot_count{8};
+    while (slot_count * 7 / 8 < n) { // smallest power of two that keeps n below max load
+        slot_count *= 2;
+    }
+    return slot_count;
+}
+
+template<typename Key, size_t N>
+void ADS_robin_set<Key, N>::allocate(size_type slot_count) {
+    dist_t *new_dist = new dist_t[slot_count];
+    try {
+        slots = std::allocator<key_type>{}.allocate(slot_count);
+    } catch (...) {
+        delete[] new_dist;
+        throw;
+    }
+    dist = new_dist;
+    std::memset(dist, dist_free, slot_count);
+    capacity = slot_count;
+    current_size = 0;
+}
+
+template<typename Key, size_t N>
+void ADS_robin_set<Key, N>::release() {
+    for (size_type i = 0; i < capacity; ++i) {
+        if (dist[i] != dist_free) {
+            slots[i].~key_type();
+        }
+    }
+    if (slots) {
+        std::allocator<key_type>{}.deallocate(slots, capacity);
+    }
+    delete[] dist;
+    dist = nullptr;
+    slots = nullptr;
+    capacity = 0;
+    current_size = 0;
+}
+
+template<typename Key, size_t N>
+typename ADS_robin_set<Key, N>::size_type ADS_robin_set<Key, N>::locate(const key_type &key, size_type hash) const {
+    size_type i = home(hash);
+    for (size_type d = 0; d < capacity; ++d, i = (i + 1) & (capacity - 1)) {
+        if (dist[i] == dist_free) {
+            return capacity;
+        }
+        if (dist[i] != dist_saturated) {
+            if (dist[i] - 1u < d) { // key would have robbed this slot, it is not in the table
+                return capacity;
+            }
+            if (dist[i] - 1u == d && key_equal{}(slots[i], key)) { // only keys with the same home are compared
+                return i;
+            }
+        } else if (key_equal{}(slots[i], key)) {
+            return i;
+        }
+    }
+    return capacity;
+}
+
+template<typename Key, size_t N>
+template<typename ForwardIt, typename Fn>
+void ADS_robin_set<Key, N>::lookup_many(ForwardIt first, ForwardIt last, Fn found) const {
+    constexpr size_type batch = 16;
+    size_type hashes[batch];
+    while (first != last) {
+        ForwardIt batch_first = first;
+        size_type filled{0};
+        for (; filled < batch && first != last; ++filled, ++first) {
+            hashes[filled] = ADS_mix(hasher{}(*first));
+            size_type i = home(hashes[filled]);
+            __builtin_prefetch(dist + i);
+            __builtin_prefetch(slots + i);
+        }
+        for (size_type i = 0; i < filled; ++i, ++batch_first) {
+            found(locate(*batch_first, hashes[i]));
+        }
+    }
+}
+
+template<typename Key, size_t N>
+typename ADS_robin_set<Key, N>::size_type ADS_robin_set<Key, N>::place(key_type key, size_type hash) {
+    size_type i = home(hash);
+    size_type placed = capacity; // slot of the key passed in, the keys carried on afterwards are others
+    for (size_type d = 0;; ++d, i = (i + 1) & (capacity - 1)) { // max load guarantees a free slot
+        if (dist[i] == dist_free) {
+            ::new(static_cast<void *>(slots + i)) key_type(std::move(key));
+            dist[i] = encode(d);
+            return placed == capacity ? i : placed;
+        }
+        size_type other = distance(i);
+        if (other < d) { // the resident is closer to home, it moves on instead
+            std::swap(key, slots[i]);
+            dist[i] = encode(d);
+            d = other;
+            if (placed == capacity) {
+                placed = i;
+            }
+        }
+    }
+}
+
+template<typename Key, size_t N>
+void ADS_robin_set<Key, N>::rehash(size_type slot_count) {
+    dist_t *old_dist = dist;
+    key_type *old_slots = slots;
+    size_type old_capacity = capacity;
+    size_type old_size = current_size;
+
+    allocate(slot_count);
+    for (size_type i = 0; i < old_capacity; ++i) {
+        if (old_dist[i] != dist_free) {
+            size_type hash = ADS_mix(hasher{}(old_slots[i]));
+            place(std::move(old_slots[i]), hash); // keys are moved, not copied
+            old_slots[i].~key_type();
+        }
+    }
+    current_size = old_size;
+
+    std::allocator<key_type>{}.deallocate(old_slots, old_capacity);
+    delete[] old_dist;
+}
+
+template<typename Key, size_t N>
+ADS_robin_set<Key, N>::ADS_robin_set(const ADS_robin_set &other) {
+    allocate(other.capacity);
+    for (size_type i = 0; i < other.capacity; ++i) { // same capacity, so every key keeps its slot
+        if (other.dist[i] != dist_free) {
+            ::new(static_cast<void *>(slots + i)) key_type(other.slots[i]);
+            dist[i] = other.dist[i];
+        }
+    }
+    current_size = other.current_size;
+}
+
+template<typename Key, size_t N>
+ADS_robin_set<Key, N> &ADS_robin_set<Key, N>::operator=(const ADS_robin_set &other) {
+    if (this != &other) {
+        ADS_robin_set copy{other};
+        swap(copy);
+    }
+    return *this;
+}
+
+template<typename Key, size_t N>
+ADS_robin_set<Key, N> &ADS_robin_set<Key, N>::operator=(std::initializer_list<key_type> ilist) {
+    clear();
+    insert(ilist);
+    return *this;
+}
+
+template<typename Key, size_t N>
+std::pair<typename ADS_robin_set<Key, N>::iterator, bool> ADS_robin_set<Key, N>::insert(const key_type &key) {
+    size_type hash = ADS_mix(hasher{}(key)); // hashing only once
+    size_type i = locate(key, hash);
+    if (i != capacity) {
+        return {iterator(dist + i, slots + i, dist + capacity), false};
+    }
+    if ((current_size + 1) * 8 > capacity * 7) {
+        rehash(capacity * 2);
+    }
+    i = place(key, hash);
+    ++current_size;
+    return {iterator(dist + i, slots + i, dist + capacity), true};
+}
+
+template<typename Key, size_t N>
+template<typename InputIt>
+void ADS_robin_set<Key, N>::insert(InputIt first, InputIt last) {
+    for (auto it{first}; it != last; ++it) {
+        insert(*it);
+    }
+}
+
+template<typename Key, size_t N>
+void ADS_robin_set<Key, N>::clear() {
+    ADS_robin_set buffer;
+    swap(buffer);
+}
+
+template<typename Key, size_t N>
+typename ADS_robin_set<Key, N>::size_type ADS_robin_set<Key, N>::erase(const key_type &key) {
+    size_type i = locate(key, ADS_mix(hasher{}(key)));
+    if (i == capacity) {
+        return 0;
+    }
+    slots[i].~key_type();
+    for (size_type next = (i + 1) & (capacity - 1);
+         dist[next] != dist_free && dist[next] != 1; // stops at a free slot or a key at its home slot
+         i = next, next = (next + 1) & (capacity - 1)) {
+        size_type d = distance(next);
+        ::new(static_cast<void *>(slots + i)) key_type(std::move(slots[next]));
+        slots[next].~key_type();
+        dist[i] = encode(d - 1);
+    }
+    dist[i] = dist_free;
+    --current_size;
+    return 1;
+}
+
+template<typename Key, size_t N>
+typename ADS_robin_set<Key, N>::iterator ADS_robin_set<Key, N>::find(const key_type &key) const {
+    size_type i = locate(key, ADS_mix(hasher{}(key)));
+    if (i != capacity) {
+        return iterator(dist + i, slots + i, dist + capacity);
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+void ADS_robin_set<Key, N>::swap(ADS_robin_set &other) {
+    std::swap(dist, other.dist);
+    std::swap(slots, other.slots);
+    std::swap(capacity, other.capacity);
+    std::swap(current_size, other.current_size);
+}
+
+template<typename Key, size_t N>
+typename ADS_robin_set<Key, N>::const_iterator ADS_robin_set<Key, N>::begin() const {
+    const_iterator it(dist, slots, dist + capacity);
+    if (capacity && dist[0] == dist_free) {
+        ++it;
+    }
+    return it;
+}
+
+template<typename Key, size_t N>
+typename ADS_robin_set<Key, N>::const_iterator ADS_robin_set<Key, N>::end() const {
+    return const_iterator();
+}
+
+template<typename Key, size_t N>
+void ADS_robin_set<Key, N>::dump(std::ostream &o) const {
+    o << "Capacity = " << capacity << ", Current size = " << current_size << "\n";
+    for (size_type i = 0; i < capacity; ++i) {
+        o << i << " : ";
+        if (dist[i] == dist_free) {
+            o << "--Free\n";
+        } else {
+            o << slots[i] << " (distance = " << distance(i) << ")\n";
+        }
+    }
+}
+
+template<typename Key, size_t N>
+class ADS_robin_set<Key, N>::Iterator {
+    const dist_t *dist;
+    const key_type *slot;
+    const dist_t *dist_end;
+
+    void skip() { // moving to the next used slot or to end
+        while (dist != dist_end && *dist == dist_free) {
+            ++dist;
+            ++slot;
+        }
+        if (dist == dist_end) {
+            slot = nullptr;
+        }
+    }
+
+public:
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using pointer = const value_type *;
+    using iterator_category = std::forward_iterator_tag;
+
+    explicit Iterator(const dist_t *dist = nullptr, const key_type *slot = nullptr, const dist_t *dist_end = nullptr)
+            : dist{dist}, slot{slot}, dist_end{dist_end} {}
+
+    reference operator*() const {
+        return *slot;
+    }
+
+    pointer operator->() const {
+        return slot;
+    }
+
+    Iterator &operator++() {
+        ++dist;
+        ++slot;
+        skip();
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        auto ret_code{*this};
+        ++*this;
+        return ret_code;
+    }
+
+    friend bool operator==(const Iterator &lhs, const Iterator &rhs) {
+        return lhs.slot == rhs.slot;
+    }
+
+    friend bool operator!=(const Iterator &lhs, const Iterator &rhs) {
+        return !(lhs.slot == rhs.slot);
+    }
+};
+
+template<typename Key, size_t N>
+void swap(ADS_robin_set<Key, N> &lhs, ADS_robin_set<Key, N> &rhs) { lhs.swap(rhs); }
+
+#endif // ADS_ROBIN_SET_H
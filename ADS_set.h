@@ -5,12 +5,217 @@
 #include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <vector>
+#include <cmath>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cstdint>
+#include <memory_resource>
+#include <array>
+#include <utility>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <exception>
+#include <execution>
+
+#include "ADS_hash_mix.h"
 
-template<typename Key, size_t N = 7>
+/*
+  Growth policies decide which table sizes ADS_set uses and in which box a hash value ends up:
+  1. round_up(n) - smallest table size of the policy which is at least n
+  2. set_size(table_size) - called after every rehash with a size returned by round_up()
+  3. index(hash) - box for a hash value, in [0, table_size)
+  Optional: splits_boxes = true if growing by a factor k sends the keys of box i only to the boxes
+  [i * k, (i + 1) * k), ADS_set then rehashes large tables on several threads (see ADS_set_traits::parallel_rehash)
+*/
+
+//  Power of two table sizes. The hash is multiplied with 2^64 / golden ratio and the top bits are the box
+//  (multiply-shift), so identity hashes like std::hash<unsigned> are spread without any division
+class ADS_pow2_growth {
+    unsigned shift{63}; // 63 - log2(table_size), the extra >> 1 in index() makes table_size 1 work
+
+public:
+    static constexpr bool splits_boxes = true; // the box is a prefix of the bits of the bigger table's box
+
+    static size_t round_up(size_t n) {
+        size_t size{1};
+        while (size < n) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    void set_size(size_t table_size) { shift = 63 - static_cast<unsigned>(__builtin_ctzll(table_size)); }
+
+    size_t index(size_t hash) const {
+        return static_cast<size_t>(((static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> 1) >> shift);
+    }
+};
+
+//  Prime table sizes (next prime after 1.5 * 2^k), the box is hash % table_size. Every bit of the hash matters,
+//  so this is the safer choice for weak hashes. Each prime has its own modulo function with a constant divisor,
+//  which the compiler turns into a multiplication
+class ADS_prime_growth {
+    static constexpr size_t primes[] = {
+            2ULL, 3ULL, 7ULL, 13ULL, 29ULL, 53ULL, 97ULL, 193ULL, 389ULL, 769ULL, 1543ULL, 3079ULL, 6151ULL,
+            12289ULL, 24593ULL, 49157ULL, 98317ULL, 196613ULL, 393241ULL, 786433ULL, 1572869ULL, 3145739ULL,
+            6291469ULL, 12582917ULL, 25165843ULL, 50331653ULL, 100663319ULL, 201326611ULL, 402653189ULL,
+            805306457ULL, 1610612741ULL, 3221225473ULL, 6442450967ULL, 12884901893ULL, 25769803799ULL,
+            51539607599ULL, 103079215111ULL, 206158430209ULL, 412316860441ULL, 824633720837ULL,
+            1649267441681ULL, 3298534883417ULL, 6597069766657ULL, 13194139533349ULL, 26388279066671ULL,
+            52776558133303ULL, 105553116266509ULL, 211106232533047ULL, 422212465066001ULL, 844424930132057ULL,
+            1688849860263953ULL, 3377699720527897ULL, 6755399441055827ULL, 13510798882111519ULL,
+            27021597764223071ULL, 54043195528445957ULL, 108086391056891941ULL, 216172782113783843ULL,
+            432345564227567621ULL, 864691128455135281ULL, 1729382256910270481ULL, 3458764513820540933ULL,
+            6917529027641081903ULL
+    };
+    static constexpr size_t prime_count = sizeof(primes) / sizeof(primes[0]);
+
+    using mod_function = size_t (*)(size_t);
+
+    template<size_t I>
+    static size_t mod(size_t hash) { return hash % primes[I]; }
+
+    template<size_t... I>
+    static constexpr std::array<mod_function, sizeof...(I)> make_mods(std::index_sequence<I...>) {
+        return {{&mod<I>...}};
+    }
+
+    static size_t position(size_t n) {
+        return static_cast<size_t>(std::lower_bound(primes, primes + prime_count - 1, n) - primes);
+    }
+
+    mod_function mod_size{&mod<0>};
+
+public:
+    static size_t round_up(size_t n) { return primes[position(n)]; }
+
+    void set_size(size_t table_size) {
+        static constexpr std::array<mod_function, prime_count> mods = make_mods(std::make_index_sequence<prime_count>{});
+        mod_size = mods[position(table_size)];
+    }
+
+    size_t index(size_t hash) const { return mod_size(hash); }
+};
+
+//  Transparent hash for string keys: std::string, std::string_view and C strings of the same characters get the
+//  same hash value, so they can be looked up without building a std::string (see ADS_set_traits::hasher)
+struct ADS_string_hash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); }
+};
+
+/*
+  Order independent digest of the keys of a set: the sums (mod 2^64) of m and of m * m over the mixed hash values m of
+  all keys (see ADS_mix(), identity hashes would give linear sums otherwise), so the digest of a set is the same no
+  matter in which order its keys were added and erased. Sets with different digests have different keys, equal
+  digests only say that the keys are probably the same.
+  Digests of sets in different processes can be compared as long as the hasher gives the same values there.
+*/
+struct ADS_set_digest {
+    std::uint64_t low{0};
+    std::uint64_t high{0};
+
+//  Takes the hash value of a key into the digest, or out again
+    void add(size_t hash) {
+        std::uint64_t m = ADS_mix(hash);
+        low += m;
+        high += m * m;
+    }
+
+    void remove(size_t hash) {
+        std::uint64_t m = ADS_mix(hash);
+        low -= m;
+        high -= m * m;
+    }
+
+//  Digest of the keys of both (disjoint) sets
+    ADS_set_digest &operator+=(const ADS_set_digest &other) {
+        low += other.low;
+        high += other.high;
+        return *this;
+    }
+
+    friend bool operator==(const ADS_set_digest &lhs, const ADS_set_digest &rhs) {
+        return lhs.low == rhs.low && lhs.high == rhs.high;
+    }
+
+    friend bool operator!=(const ADS_set_digest &lhs, const ADS_set_digest &rhs) { return !(lhs == rhs); }
+};
+
+//  True if growth policy T has splits_boxes = true
+template<typename T, typename = void>
+struct ADS_splits_boxes : std::false_type {
+};
+
+template<typename T>
+struct ADS_splits_boxes<T, std::void_t<decltype(T::splits_boxes)>> : std::bool_constant<T::splits_boxes> {
+};
+
+//  True if hash or comparison function T accepts other types than the key (T::is_transparent exists)
+template<typename T, typename = void>
+struct ADS_is_transparent : std::false_type {
+};
+
+template<typename T>
+struct ADS_is_transparent<T, std::void_t<typename T::is_transparent>> : std::true_type {
+};
+
+/*
+  Compile-time options of ADS_set. Defaults can be changed by deriving from this struct, e.g.
+  struct compact_traits : ADS_set_traits<unsigned> { static constexpr bool compact_links = true; };
+  ADS_set<unsigned, 7, compact_traits> set;
+*/
+template<typename Key>
+struct ADS_set_traits {
+//  Chain nodes are linked with 32-bit indices into the node pool instead of 64-bit pointers
+    static constexpr bool compact_links = false;
+
+//  Table sizes and hash to box mapping, ADS_pow2_growth or ADS_prime_growth
+    using growth_policy = ADS_pow2_growth;
+
+//  Hash and comparison of keys. If both are transparent (have is_transparent), find(), count(), erase() and
+//  insert() take every type they accept, e.g. std::string_view for std::string keys with ADS_string_hash and
+//  std::equal_to<>. A key is only constructed if insert() doesn't find it
+    using hasher = std::hash<Key>;
+    using key_equal = std::equal_to<Key>;
+
+//  Every element stores the full hash value of its key. rehash() then never calls the hasher and lookups only call
+//  key_equal for elements with the same hash. Worth it for expensive hashes/comparisons, e.g. std::string keys
+    static constexpr bool cache_hash = false;
+
+//  Number of boxes of the old table moved into the grown table by every insert and erase. While the table grows
+//  both tables are searched. 0 rehashes the whole table at once, which can make a single insert very slow
+    static constexpr size_t incremental_rehash = 0;
+
+//  Growing a set with at least this many keys relinks the old boxes on all hardware threads, every thread a range
+//  of them. Only used if the growth policy splits boxes (ADS_pow2_growth), 0 always rehashes on the calling thread
+    static constexpr size_t parallel_rehash = size_t{1} << 20;
+
+//  Default load factors (keys per box) of a set, both can be changed per set. An insert grows the table once the
+//  load has reached max_load_factor. An erase which leaves the load below min_load_factor shrinks the table to the
+//  load halfway between both, so erase-heavy sets give memory back without growing again right away.
+//  0 never shrinks, otherwise it has to be below max_load_factor / 2. A grown table has half the load, which must not
+//  be low enough to shrink it again
+    static constexpr float max_load_factor = 0.7f;
+    static constexpr float min_load_factor = 0.0f;
+};
+
+template<typename Key, size_t N = 7, typename Traits = ADS_set_traits<Key>, typename Allocator = std::allocator<Key>>
 class ADS_set {
+    static_assert(N > 0, "ADS_set: initial table size N must be at least 1");
+    static_assert(Traits::min_load_factor * 2 < Traits::max_load_factor,
+                  "ADS_set: min_load_factor has to be below max_load_factor / 2");
+
 public:
     class Iterator;
 
+    class Box_range;
+
     using value_type = Key;
     using key_type = Key;
     using reference = value_type &;
@@ -20,75 +225,646 @@ public:
     using const_iterator = Iterator;
     using iterator = const_iterator;
 //    using key_compare = std::less<key_type>;                       // B+-Tree
-    using key_equal = std::equal_to<key_type>;                       // Hashing
-    using hasher = std::hash<key_type>;   //3%7 = hasher             // Hashing
+    using key_equal = typename Traits::key_equal;                    // Hashing
+    using hasher = typename Traits::hasher;   //3%7 = hasher         // Hashing
+    using allocator_type = Allocator;
 
 private:
+    using alloc_traits = std::allocator_traits<allocator_type>;
+
+//  Lookups with other types than key_type are only allowed with a transparent hasher and key_equal
+    template<typename K>
+    using if_transparent = std::enable_if_t<ADS_is_transparent<hasher>::value && ADS_is_transparent<key_equal>::value, K>;
+    using growth_policy = typename Traits::growth_policy;
+
 //  Each element has moods. Free - if it has no key and used if it has a key and stay on the first position
     enum class Mode {
         free, used
     };
 
 /*
-  Struct is a box. This box has:
+  Struct is a box of the table or an element of a chain behind a box. It has:
   1. key_type - this is something is inserted (number, string, etc)
-  2. Mode - it shows if the box is available
-  3. Element *next - it's a pointer to the next element. if it's nullptr it means this is the last element
-  4. Element() = default -- this is a default constructor without parameters.
-  5. Element(key_type key, Mode mode, Element *next) : key(key), mode(mode), next(next) {} -- this is constructor with parameters.
+  2. Mode - it shows if the box is available. Chain elements are always used
+  3. link_type next - link to the next element of the chain, an Element pointer or with Traits::compact_links a
+     32-bit index into the node pool. A value-initialised link means this is the last element
+  4. hash - the full hash of the key, only with Traits::cache_hash (Hash_field)
+  5. Element() = default -- an empty box. Element(std::in_place, next, args...) -- a chain element whose key is
+     constructed from args.
+  Boxes are the table itself. Chain elements are not allocated one by one, they are carved from the slabs of the
+  node pool and go back to its free list when they are erased (see Node_pool).
 */
-    struct Element {  // Block in my Table
+    struct Element;
+
+//  Link to the next element of a chain. Pointer, or 1-based index into the node pool if Traits::compact_links.
+//  A value-initialised link (nullptr or 0) means there is no next element
+    using link_type = std::conditional_t<Traits::compact_links, std::uint32_t, Element *>;
+
+//  Full hash value of the key, part of Element only if Traits::cache_hash
+    struct Hash_field {
+        size_type hash{0};
+    };
+    struct No_hash_field {
+    };
+
+    struct Element : std::conditional_t<Traits::cache_hash, Hash_field, No_hash_field> {  // Block in my Table
         key_type key; // Value that i indert and make hashing
         Mode mode{Mode::free}; // Mode of a block. Used if its first and not empty. Default -- free
-        Element *next{nullptr};
+        link_type next{};
 
         Element() = default;
 
-        Element(key_type key, Mode mode, Element *next) : key(key), mode(mode), next(next) {}
+//      Used chain element whose key is constructed from args
+        template<typename... Args>
+        Element(std::in_place_t, link_type next, Args &&... args)
+                : key(std::forward<Args>(args)...), mode(Mode::used), next(next) {}
+    };
+
+//  Allocator for table and chain elements, rebound from Allocator
+    using element_allocator = typename alloc_traits::template rebind_alloc<Element>;
+    using element_traits = std::allocator_traits<element_allocator>;
+
+/*
+  Node pool hands out the chain elements behind the table. Instead of one new per collision:
+  1. Elements are carved from slabs. Slab k holds (1 << first_slab_shift) << k elements, so small sets stay small
+     and big sets need only a few allocations.
+  2. Erased elements go to an intrusive free list (storage of a free element holds the link to the next free one)
+     and are reused by the next add().
+  3. Slabs are released all at once when the pool is destroyed. Shrinking the set moves its chain elements into a
+     new pool sized for them (see compact_pool()), so the slabs of an erase-heavy set are given back.
+  With compact links element i (1-based) lives in slab bit_width(i - 1 + first slab size) - 1 - first_slab_shift.
+*/
+    class Node_pool {
+        using storage_type = std::aligned_storage_t<sizeof(Element), alignof(Element)>;
+        using storage_allocator = typename alloc_traits::template rebind_alloc<storage_type>;
+        static constexpr size_type first_slab_shift = 4;
+
+//      Compact links reach at most 2^32 - 1 elements, which fit into this many slabs
+        static constexpr size_type max_compact_slabs = 33 - first_slab_shift;
+
+        storage_allocator alloc; // slabs come from the allocator of the set
+        std::vector<storage_type *> slabs; // slab k has (1 << first_slab_shift) << k elements
+        size_type used{0}; // number of elements carved from the slabs so far
+        size_type capacity{0}; // number of elements in all slabs
+        link_type free_list{}; // first free element
+        size_type free_count{0}; // number of elements on the free list
+
+//      Allocates the next slab, twice as big as the last one
+        void add_slab() {
+            size_type slab_size = (size_type{1} << first_slab_shift) << slabs.size();
+            if constexpr (Traits::compact_links) { // the slab array never moves, iterators keep it (see slab_array)
+                slabs.reserve(max_compact_slabs);
+            }
+            slabs.reserve(slabs.size() + 1); // push_back can't throw after the slab is allocated
+            slabs.push_back(std::allocator_traits<storage_allocator>::allocate(alloc, slab_size));
+            capacity += slab_size;
+        }
+
+    public:
+//      Slabs of a pool, enough to follow its links without the pool (see Iterator). Swapping or moving the pool
+//      doesn't move them
+        using slab_array = storage_type *const *;
+
+    private:
+//      Storage of the i-th element carved from the slabs (0-based)
+        static storage_type *slot(slab_array slabs, size_type i) {
+            size_type j = i + (size_type{1} << first_slab_shift);
+            size_type bit = 63 - static_cast<size_type>(__builtin_clzll(j));
+            return slabs[bit - first_slab_shift] + (j - (size_type{1} << bit));
+        }
+
+        storage_type *slot(size_type i) const { return slot(slabs.data(), i); }
+
+//      Storage of an element which is referenced by a link
+        static void *address(slab_array slabs, link_type l) {
+            if constexpr (Traits::compact_links) {
+                return slot(slabs, l - 1);
+            } else {
+                static_cast<void>(slabs);
+                return l;
+            }
+        }
+
+        void *address(link_type l) const { return address(slabs.data(), l); }
+
+//      Link of the i-th element carved from the slabs
+        link_type link_of(size_type i) const {
+            if constexpr (Traits::compact_links) {
+                if (i >= UINT32_MAX) {
+                    throw std::length_error("ADS_set: more than 2^32 - 2 chain elements with compact links");
+                }
+                return static_cast<link_type>(i + 1);
+            } else {
+                return reinterpret_cast<Element *>(slot(i));
+            }
+        }
+
+    public:
+        explicit Node_pool(const allocator_type &alloc) : alloc{alloc} {}
+
+        Node_pool(const Node_pool &) = delete;
+
+//      Takes all slabs, other keeps a copy of the allocator and is empty
+        Node_pool(Node_pool &&other) noexcept
+                : alloc{other.alloc}, slabs{std::move(other.slabs)}, used{other.used}, capacity{other.capacity},
+                  free_list{other.free_list}, free_count{other.free_count} {
+            other.slabs.clear();
+            other.used = 0;
+            other.capacity = 0;
+            other.free_list = link_type{};
+            other.free_count = 0;
+        }
+
+        Node_pool &operator=(const Node_pool &) = delete;
+
+//      Only memory is released here, keys of used elements have to be destroyed by the owner
+        ~Node_pool() {
+            for (size_type k = 0; k < slabs.size(); ++k) {
+                std::allocator_traits<storage_allocator>::deallocate(alloc, slabs[k],
+                                                                     (size_type{1} << first_slab_shift) << k);
+            }
+        }
+
+        allocator_type get_allocator() const { return allocator_type(alloc); }
+
+//      Allocator for the table, it has to be the same as the one of the slabs
+        element_allocator get_element_allocator() const { return element_allocator(alloc); }
+
+//      with_allocator is false if the allocators must stay with their containers (see swap())
+        template<bool with_allocator>
+        void swap(Node_pool &other) {
+            if constexpr (with_allocator) {
+                using std::swap;
+                swap(alloc, other.alloc);
+            }
+            slabs.swap(other.slabs);
+            std::swap(used, other.used);
+            std::swap(capacity, other.capacity);
+            std::swap(free_list, other.free_list);
+            std::swap(free_count, other.free_count);
+        }
+
+        slab_array slab_data() const { return slabs.data(); }
+
+//      Element referenced by a link of the pool with slabs, nullptr for the empty link
+        static Element *get(slab_array slabs, link_type l) {
+            if (!l) {
+                return nullptr;
+            }
+            return std::launder(static_cast<Element *>(address(slabs, l)));
+        }
+
+        Element *get(link_type l) const { return get(slabs.data(), l); }
+
+//      Creates a used element in front of next, its key is constructed from args
+        template<typename... Args>
+        link_type make(link_type next, Args &&... args);
+
+//      Reserves count fresh elements for a bulk build and returns the index of the first one. Each of the elements
+//      first .. first + count - 1 (see link_at()) is then either constructed or recycled, different elements may be
+//      handled by different threads at the same time
+        size_type carve(size_type count);
+
+        link_type link_at(size_type i) const { return link_of(i); }
+
+//      Makes sure the next count make() calls don't allocate, free elements are used first
+        void reserve(size_type count) {
+            while (capacity - used + free_count < count) {
+                add_slab();
+            }
+        }
+
+//      True if a pool for count elements would need fewer slabs than this one has
+        bool oversized(size_type count) const {
+            size_type k{0};
+            for (size_type fits{0}; fits < count; ++k) {
+                fits += (size_type{1} << first_slab_shift) << k;
+            }
+            return k < slabs.size();
+        }
+
+//      Constructs a used element in carved storage l, in front of next
+        template<typename... Args>
+        void construct(link_type l, link_type next, Args &&... args) {
+            element_allocator a(alloc);
+            element_traits::construct(a, static_cast<Element *>(address(l)), std::in_place, next,
+                                      std::forward<Args>(args)...);
+        }
+
+//      Puts storage without an element (carved or left over by a failed construction) on the free list
+        void recycle(link_type l) {
+            ::new(address(l)) link_type(free_list);
+            free_list = l;
+            ++free_count;
+        }
+
+//      Free elements collected apart from the pool, e.g. by one thread of a parallel rehash, see give_back()
+        struct Free_list {
+            link_type first{};
+            link_type last{};
+            size_type count{0};
+        };
+
+//      Destroys element and puts its storage on the free list
+        void destroy(link_type l) {
+            element_allocator a(alloc);
+            element_traits::destroy(a, get(l));
+            ::new(address(l)) link_type(free_list);
+            free_list = l;
+            ++free_count;
+        }
+
+//      Destroys element and puts its storage on list, the pool itself is not changed
+        void destroy(link_type l, Free_list &list) const {
+            element_allocator a(alloc);
+            element_traits::destroy(a, get(l));
+            ::new(address(l)) link_type(list.first);
+            if (!list.first) {
+                list.last = l;
+            }
+            list.first = l;
+            ++list.count;
+        }
+
+//      Puts all elements of list in front of the free list
+        void give_back(Free_list &list) {
+            if (list.first) {
+                *std::launder(static_cast<link_type *>(address(list.last))) = free_list;
+                free_list = list.first;
+                free_count += list.count;
+                list = Free_list{};
+            }
+        }
+
+//      Forgets all elements, the slabs stay and are carved again from the start. Keys of used elements have to be
+//      destroyed before
+        void reset() {
+            used = 0;
+            free_list = link_type{};
+            free_count = 0;
+        }
     };
 
 //  Initialising a pointer to the object type Element
     Element *table{nullptr};
 
+//  Chain elements behind the table
+    Node_pool pool;
+
 //  Table size shows vertical length of the table
     size_type table_size{0};
 
+//  Occupancy bitmap of the table, bit idx % 64 of word idx / 64 is set if box idx has a key. Iteration jumps over
+//  64 free boxes per word with it. The boxes of an old table (incremental rehash) have no bitmap
+    std::uint64_t *occupied{nullptr};
+
+//  First box of the table with a key, table_size if there is none, so begin() doesn't have to search
+    size_type first_used{0};
+
 //  Current size show number of inserted objects in the table
     size_type current_size{0};
 
-//  Method which adds element to the box
-    void add(const key_type &key);
+//  Digest of all keys, changed together with current_size
+    ADS_set_digest keys_digest;
+
+//  Load factors (see ADS_set_traits::max_load_factor) and the numbers of keys they allow in the table: insert grows
+//  the table at grow_at keys, erase shrinks it below shrink_at keys. Integer limits, so no insert has to divide
+    float max_load{Traits::max_load_factor};
+    float min_load{Traits::min_load_factor};
+    size_type grow_at{0};
+    size_type shrink_at{0};
+
+//  Maps hash values to boxes of the current table
+    growth_policy growth;
+
+//  Old table during an incremental rehash (Traits::incremental_rehash), its boxes [done, table_size) still
+//  have to be moved into the table. table_size is 0 if no rehash is running
+    struct Migration {
+        Element *table{nullptr};
+        size_type table_size{0};
+        size_type done{0};
+        growth_policy growth;
+    };
+    Migration old;
+
+/*
+  Storage of a set as iterators see it: the table with its bitmap, the old table of a running incremental rehash and
+  the slabs of the node pool. All of it is memory the set points to, so iterators keep pointing to the same keys when
+  the set is swapped or moved (only the set object itself changes).
+*/
+    struct Storage {
+        Element *table{nullptr};
+        size_type table_size{0};
+        const std::uint64_t *occupied{nullptr};
+        Element *old_table{nullptr};
+        size_type old_table_size{0};
+        typename Node_pool::slab_array slabs{nullptr};
+
+        size_type box_count() const { return table_size + old_table_size; }
+
+        Element *box(size_type idx) const {
+            if constexpr (Traits::incremental_rehash > 0) {
+                return idx < table_size ? &table[idx] : &old_table[idx - table_size];
+            } else {
+                return &table[idx];
+            }
+        }
+
+        Element *node(link_type l) const { return Node_pool::get(slabs, l); }
+
+//      First box of the table with a key at or after idx, table_size if there is none
+        size_type next_used(size_type idx) const;
+
+//      First box with a key at or after idx, in the order of box() (old table included), box_count() if there is none
+        size_type next_box(size_type idx) const;
+    };
+
+    Storage storage() const { return Storage{table, table_size, occupied, old.table, old.table_size, pool.slab_data()}; }
+
+//  Method which puts key into the box idx like add(), but current_size stays the same
+    template<typename K>
+    Element *place(size_type idx, size_type hash, K &&key);
+
+//  Method which adds element to the box idx (idx has to be h(hash), hash the full hash of key) and returns the
+//  element holding it. An rvalue key is moved into the table
+    template<typename K>
+    Element *add(size_type idx, size_type hash, K &&key);
+
+//  Method which makes room for one more element (grows the table if it is too full or was moved from)
+    void prepare_insert();
+
+//  Method which computes grow_at and shrink_at for the table, after every change of table_size or a load factor
+    void set_limits() {
+        grow_at = static_cast<size_type>(std::ceil(static_cast<double>(table_size) * max_load));
+        shrink_at = static_cast<size_type>(static_cast<double>(table_size) * min_load);
+    }
+
+//  Method which takes over the load factors of from, for a copy of another set which is going to replace from
+    void use_limits_of(const ADS_set &from) {
+        max_load = from.max_load;
+        min_load = from.min_load;
+        set_limits();
+        reserve(current_size);
+    }
+
+//  Boxes needed for n keys at most at max_load_factor
+    size_type boxes_for(size_type n) const {
+        return static_cast<size_type>(std::ceil(static_cast<double>(n) / max_load));
+    }
+
+//  Method which shrinks the table after an erase if it is too empty (see ADS_set_traits::min_load_factor)
+    void shrink_if_sparse() {
+        if (current_size < shrink_at) {
+            shrink();
+        }
+    }
+
+    void shrink();
+
+//  Method which moves the chain elements into a new pool sized for them, so the slabs left over by erases are
+//  released. Keys whose move constructor may throw stay where they are
+    void compact_pool();
+
+//  Method which inserts a copy of key or moves key into the table. With a transparent hasher key may have another
+//  type, key_type is constructed from it only when it is added
+    template<typename K>
+    std::pair<iterator, bool> insert_key(K &&key) { return insert_hashed(std::forward<K>(key), full_hash(key)); }
 
-//  Method which finds an element in the table
-    Element *locate(const key_type &key) const;
+//  Like insert_key(), hash is the full hash of key
+    template<typename K>
+    std::pair<iterator, bool> insert_hashed(K &&key, size_type hash);
 
- // Method which counts a place in hach table
-   size_type h(const key_type &key) const {
-       return hasher{}(key) % table_size;
+//  Method which moves all keys of other into my table, other is empty afterwards. The load factors of other are
+//  taken too
+    void take_keys(ADS_set &other);
+
+//  Method which finds an element, hash is the full hash of key. idx is set to the box of the element
+    template<typename K>
+    Element *locate(const K &key, size_type hash, size_type &idx) const;
+
+//  Method which finds an element in the chain starting at the box head
+    template<typename K>
+    Element *search(Element &head, const K &key, size_type hash) const;
+
+//  Method which looks up the keys of [first, last) and calls found(element, idx) for every key in order, element is
+//  nullptr for a missing key. A key is hashed and its box prefetched 16 keys before it is compared, its first chain
+//  element is prefetched 8 keys before, so the cache misses of 16 lookups overlap
+    template<typename ForwardIt, typename Fn>
+    void lookup_many(ForwardIt first, ForwardIt last, Fn found) const;
+
+//  Methods behind find() and erase() for key_type and transparent lookups
+    template<typename K>
+    iterator find_key(const K &key) const;
+
+    template<typename K>
+    size_type erase_key(const K &key);
+
+//  Method which deletes key from the chain starting at the box head, returns the number of deleted elements
+    template<typename K>
+    size_type erase_from(Element &head, const K &key, size_type hash);
+
+//  Boxes of the table followed by the boxes of the old table during an incremental rehash
+    size_type box_count() const { return table_size + old.table_size; }
+
+    Element *box(size_type idx) const {
+        if constexpr (Traits::incremental_rehash > 0) {
+            return idx < table_size ? &table[idx] : &old.table[idx - table_size];
+        } else {
+            return &table[idx];
+        }
+    }
+
+//  Full hash of a key, every operation computes it only once
+    template<typename K>
+    static size_type full_hash(const K &key) { return hasher{}(key); }
+
+//  Full hash of an element: the stored one with Traits::cache_hash, otherwise it is computed again
+    size_type hash_of(const Element &e) const {
+        if constexpr (Traits::cache_hash) {
+            return e.hash;
+        } else {
+            return full_hash(e.key);
+        }
+    }
+
+//  Hash to pass on to add() if the box is already known: the stored one, or nothing if hashes are not stored
+    static size_type cached_hash(const Element &e) {
+        if constexpr (Traits::cache_hash) {
+            return e.hash;
+        } else {
+            static_cast<void>(e);
+            return 0;
+        }
+    }
+
+    static void set_hash(Element &e, size_type hash) {
+        if constexpr (Traits::cache_hash) {
+            e.hash = hash;
+        } else {
+            static_cast<void>(e);
+            static_cast<void>(hash);
+        }
+    }
+
+//  Elements with different stored hashes can't have equal keys, key_equal is not needed for them
+    static bool same_hash(const Element &e, size_type hash) {
+        if constexpr (Traits::cache_hash) {
+            return e.hash == hash;
+        } else {
+            static_cast<void>(e);
+            static_cast<void>(hash);
+            return true;
+        }
+    }
+
+//  Method which follows a link to the next element of a chain
+    Element *node(link_type l) const { return pool.get(l); }
+
+//  Methods which create and destroy a table with i free elements using the allocator
+    Element *allocate_table(size_type i);
+
+    void deallocate_table(Element *t, size_type i);
+
+//  Methods which create (all boxes free) and destroy the occupancy bitmap of a table with i boxes
+    using word_allocator = typename alloc_traits::template rebind_alloc<std::uint64_t>;
+
+    static size_type bitmap_words(size_type i) { return (i + 63) / 64; }
+
+    std::uint64_t *allocate_bitmap(size_type i);
+
+    void deallocate_bitmap(std::uint64_t *bits, size_type i);
+
+//  Methods which keep the bitmap and first_used up to date when the head of box idx of the table gets a key or
+//  loses its last one. Threads filling disjoint ranges of 64 boxes can call mark_used() at the same time if
+//  first_used is 0 meanwhile (then it is never written), see reset_first_used()
+    void mark_used(size_type idx) {
+        occupied[idx / 64] |= std::uint64_t{1} << (idx % 64);
+        if (idx < first_used) {
+            first_used = idx;
+        }
+    }
+
+    void mark_free(size_type idx) {
+        occupied[idx / 64] &= ~(std::uint64_t{1} << (idx % 64));
+        if (idx == first_used) {
+            first_used = next_used(idx);
+        }
+    }
+
+    void reset_first_used() { first_used = next_used(0); }
+
+//  See Storage::next_used() and Storage::next_box()
+    size_type next_used(size_type idx) const { return storage().next_used(idx); }
+
+    size_type next_box(size_type idx) const { return storage().next_box(idx); }
+
+//  Method which swaps everything, allocators only if with_allocator
+    template<bool with_allocator>
+    void swap_storage(ADS_set &other);
+
+ // Method which counts a place in hach table from the full hash of a key
+   size_type h(size_type hash) const {
+       return growth.index(hash);
    }
 
-//  Method which reserves place for elements
-    void reserve(size_type i);
+//  Method which rehash the table, i is rounded up to a size of the growth policy. Keys in the table are moved,
+//  chain elements are relinked into their new boxes, only the new table is allocated
+    void rehash_to(size_type i);
+
+//  Method which moves the keys of the box head (of an old table) into the table. Returns true if the head key is
+//  still there, because its new box got a head key already (only possible if the growth policy doesn't split boxes).
+//  Chain elements whose key moves into a head are freed to the pool, or to *freed if it is given
+    bool relink(Element &head, typename Node_pool::Free_list *freed = nullptr);
+
+//  Number of threads relinking an old table of old_table_size boxes into the table, 1 if it is not worth it or not
+//  possible (see Traits::parallel_rehash)
+    unsigned rehash_threads(size_type old_table_size) const;
+
+//  Method which allocates a table with at least i boxes, the current table becomes the old table
+    void start_migration(size_type i);
+
+//  Method which moves up to boxes boxes of the old table into the table and deletes the old table when done
+    void migrate(size_type boxes);
+
+//  Method which calls fn(t) for t in [0, threads), on threads threads (the calling one included). The first
+//  exception is rethrown after all calls are done
+    template<typename Fn>
+    static void run_parallel(unsigned threads, Fn fn);
 
-//  Method which rehash the table
-    void rehash(size_type i);
+//  Method which calls fn(key) for the keys of the boxes [first, last) (see box()), chain by chain
+    template<typename Fn>
+    void for_each_in(size_type first, size_type last, Fn &fn) const;
+
+//  Number of threads for a parallel algorithm over boxes boxes: 1 for std::execution::seq, otherwise one per core,
+//  but at least 16K boxes per thread
+    template<typename ExecutionPolicy>
+    static unsigned policy_threads(size_type boxes);
+
+//  Iterator to the first key of the boxes [idx, box_count()), end() if there is none
+    const_iterator first_from(size_type idx) const;
+
+//  Method which sorts copies of the keys of this set by whether other has them, into *found and *missing (nullptr if
+//  not needed). other is probed in batches (see lookup_many()), with a parallel ExecutionPolicy every thread probes
+//  the keys of a range of boxes of this set
+    template<typename ExecutionPolicy>
+    void partition_keys(const ADS_set &other, std::vector<key_type> *found, std::vector<key_type> *missing) const;
+
+//  Method which moves keys into the table, with a parallel ExecutionPolicy by insert_parallel()
+    template<typename ExecutionPolicy>
+    void insert_moved(std::vector<key_type> &keys);
+
+//  Set algebra operations with an execution policy are only there for execution policies
+    template<typename ExecutionPolicy>
+    using if_policy = std::enable_if_t<std::is_execution_policy<std::decay_t<ExecutionPolicy>>::value>;
 
 public:
 //  This is a default constructor without parameters
-//  rehash(N) creates a set with default table_size = 7
-    ADS_set() { rehash(N); };
+//  rehash_to(N) creates a set with at least N boxes (8 with the default power of two growth policy)
+    ADS_set() : ADS_set(allocator_type()) {}
+
+//  Constructor for an empty set whose table and chain elements come from alloc
+    explicit ADS_set(const allocator_type &alloc) : pool{alloc} { rehash_to(N); }
 
 //  This is a constructor which initialises with ilist (special list with some elements)
 //  This constrictor initialise an objekt of the class ADS_set and adds some elements in it
-    ADS_set(std::initializer_list<key_type> ilist) : ADS_set{} { insert(ilist); }
+    ADS_set(std::initializer_list<key_type> ilist, const allocator_type &alloc = allocator_type())
+            : ADS_set(alloc) { insert(ilist); }
 
 //  This is a template constructor which initialise ADS_set which receives 2 iterators: first (shows first element), last (shows last element)
 //  and adds all elements from first till last
     template<typename InputIt>
-    ADS_set(InputIt first, InputIt last): ADS_set() { insert(first, last); }
+    ADS_set(InputIt first, InputIt last, const allocator_type &alloc = allocator_type()): ADS_set(alloc) {
+        insert(first, last);
+    }
 
 //  This is a copy constructor. It should initialise my ADS_set by copying another ADS_set, which is passed like argument.
-    ADS_set(const ADS_set &other);
+//  The allocator is chosen by select_on_container_copy_construction
+    ADS_set(const ADS_set &other)
+            : ADS_set(other, alloc_traits::select_on_container_copy_construction(other.get_allocator())) {}
+
+//  Copy constructor which uses alloc for the copy
+    ADS_set(const ADS_set &other, const allocator_type &alloc);
+
+//  This is a move constructor. It takes the table, the chain elements and the allocator of other.
+//  other is left without a table, it is valid and empty and gets a new table on the next insert
+    ADS_set(ADS_set &&other) noexcept
+            : table{other.table}, pool{std::move(other.pool)}, table_size{other.table_size},
+              occupied{other.occupied}, first_used{other.first_used}, current_size{other.current_size},
+              keys_digest{other.keys_digest}, max_load{other.max_load}, min_load{other.min_load},
+              grow_at{other.grow_at}, shrink_at{other.shrink_at}, growth{other.growth}, old{other.old} {
+        other.table = nullptr;
+        other.table_size = 0;
+        other.grow_at = 0;
+        other.shrink_at = 0;
+        other.occupied = nullptr;
+        other.first_used = 0;
+        other.current_size = 0;
+        other.keys_digest = ADS_set_digest{};
+        other.old = Migration{};
+    }
+
+//  Move constructor which uses alloc. If alloc differs from the allocator of other, keys are moved one by one
+    ADS_set(ADS_set &&other, const allocator_type &alloc);
 
 //  This is destructor. It should delete my ADS_set. It should delete not only vertical, but also horizontal.
     ~ADS_set();
@@ -96,15 +872,57 @@ public:
 //  This is copy operator. It should copy from "other" to my ADS_set. It should return a reference to *this
     ADS_set &operator=(const ADS_set &other);
 
+//  This is move operator. The table of other is taken if the allocator propagates or both allocators are equal,
+//  otherwise keys are moved one by one into memory of my allocator
+    ADS_set &operator=(ADS_set &&other) noexcept(alloc_traits::propagate_on_container_move_assignment::value ||
+                                                 alloc_traits::is_always_equal::value);
+
 //  This operator should add elements from ilist to my ADS_set. It should return a reference to *this
     ADS_set &operator=(std::initializer_list<key_type> ilist);
 
+//  Returns a copy of the allocator
+    allocator_type get_allocator() const { return pool.get_allocator(); }
+
 //  Method shows a number of elements in my container
     size_type size() const { return current_size; }
 
 //  Method returns true if there is no elements in my table and false otherwise
     bool empty() const { return current_size == 0; }
 
+//  Keys per box of the table
+    float load_factor() const {
+        return table_size ? static_cast<float>(current_size) / static_cast<float>(table_size) : 0.0f;
+    }
+
+//  Load at which an insert grows the table. Setting it grows the table right away if it is too full already, it has
+//  to be above 2 * min_load_factor()
+    float max_load_factor() const { return max_load; }
+
+    void max_load_factor(float ml);
+
+//  Load below which an erase shrinks the table, 0 never shrinks (see ADS_set_traits::min_load_factor). It has to be
+//  below max_load_factor() / 2. Setting it doesn't shrink the table, the next erase does
+    float min_load_factor() const { return min_load; }
+
+    void min_load_factor(float ml);
+
+//  Number of boxes of the table (without an old table of a running incremental rehash)
+    size_type bucket_count() const { return table_size; }
+
+//  Makes room for n keys, inserts don't grow the table until there are more
+    void reserve(size_type n);
+
+//  Rehashes into a table with at least buckets boxes, and at least as many as the keys need at max_load_factor().
+//  The table may get smaller
+    void rehash(size_type buckets);
+
+//  Rehashes into the smallest table for the keys (not below N boxes) and releases the slabs of the node pool the
+//  chain elements don't need
+    void shrink_to_fit();
+
+//  Order independent digest of the keys (see ADS_set_digest), kept up to date by every insert and erase
+    ADS_set_digest digest() const { return keys_digest; }
+
 //  This method inserts element from ilist to my ADS_set in given order.
     void insert(std::initializer_list<key_type> ilist) { insert(ilist.begin(), ilist.end()); }
 
@@ -113,293 +931,1410 @@ public:
 //  If element was NOT inserted: Iterator points to an element which is already in the table, bool returns false
     std::pair<iterator, bool> insert(const key_type &key);
 
-//  This method inserts elements. First and Last are iterators which shows a range of elements, that should be inserted
+//  Like previous method, but the key is moved into the table if it is not there yet
+    std::pair<iterator, bool> insert(key_type &&key);
+
+//  Insert with a key of another type (transparent hasher and key_equal only). key_type is only constructed from
+//  key if it is not in the table yet
+    template<typename K, typename = if_transparent<K>>
+    std::pair<iterator, bool> insert(K &&key) { return insert_key(std::forward<K>(key)); }
+
+//  Constructs a key from args and inserts it. A single key_type argument is passed on to insert(), otherwise the
+//  key is constructed directly in a chain element and this element is dropped again if the key is already there
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args &&... args);
+
+//  This method inserts elements. First and Last are iterators which shows a range of elements, that should be inserted.
+//  For forward iterators the table is grown once for the whole range before the keys are inserted
     template<typename InputIt>
     void insert(InputIt first, InputIt last); // PH1
-//  Method deletes all elements from the ADS_set
+
+//  Bulk insert of a random access range on threads threads (0: one per core), same result as insert(first, last).
+//  The keys are hashed in parallel and partitioned by the range of boxes they land in, then every thread fills the
+//  boxes and chains of its own range without synchronization. Small ranges are inserted sequentially. With move
+//  iterators the keys which are added are moved into the table
+    template<typename RandomIt>
+    void insert_parallel(RandomIt first, RandomIt last, unsigned threads = 0);
+//  Method deletes all elements from the ADS_set. The table and the chain elements are kept for the next inserts,
+//  only boxes with keys are visited (see the occupancy bitmap)
     void clear();
 
-//  Method deletes a chosen element. My ADS_set shouldn't be rehashed after deleting
-    size_type erase(const key_type &key);
+//  Like clear(), but the memory is released too, the set is as small as a new one afterwards
+    void clear_and_shrink();
+
+//  Method deletes a chosen element. The table is only rehashed (and iterators invalidated) if the load drops below
+//  min_load_factor()
+    size_type erase(const key_type &key) { return erase_key(key); }
+
+//  erase() with a key of another type (transparent hasher and key_equal only)
+    template<typename K, typename = if_transparent<K>>
+    size_type erase(const K &key) { return erase_key(key); }
 
 //  Method should return 1 if key in arguments located in my ADS_set and 0 otherwise.
     size_type count(const key_type &key) const {
-        return locate(key) != nullptr;
+        size_type idx;
+        return locate(key, full_hash(key), idx) != nullptr;
+    }
+
+//  count() with a key of another type (transparent hasher and key_equal only)
+    template<typename K, typename = if_transparent<K>>
+    size_type count(const K &key) const {
+        size_type idx;
+        return locate(key, full_hash(key), idx) != nullptr;
     }
 
 //  This method should return an iterator to an element in my ADS_set if element is found, otherwise it returns end-iterator
-    iterator find(const key_type &key) const;
+    iterator find(const key_type &key) const { return find_key(key); }
+
+//  find() with a key of another type (transparent hasher and key_equal only)
+    template<typename K, typename = if_transparent<K>>
+    iterator find(const K &key) const { return find_key(key); }
+
+//  Batched count(): writes count(key) for every key of [first, last) to out, returns the end of the output.
+//  The lookups of up to 16 keys run at the same time, which pays off if keys don't fit into the cache (e.g. strings)
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt count_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [&out](Element *found, size_type) {
+            *out = size_type{found != nullptr};
+            ++out;
+        });
+        return out;
+    }
+
+//  Batched find(): writes find(key) for every key of [first, last) to out, returns the end of the output
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](Element *found, size_type idx) {
+            *out = found ? iterator(found, storage(), idx) : end();
+            ++out;
+        });
+        return out;
+    }
+
+//  This method swapped the elements of my container with the elements of another container
+//  Allocators are swapped only if propagate_on_container_swap, otherwise they have to be equal
+    void swap(ADS_set &other) { swap_storage<alloc_traits::propagate_on_container_swap::value>(other); }
+
+//  Set algebra in place, the free functions merge_union(), intersect(), subtract() and symmetric_difference()
+//  return a new set instead. The keys of the smaller set are looked up in the bigger one in batches (if this set is
+//  smaller it is replaced by a changed copy of other, which keeps my load factors), the table is grown once for all
+//  new keys. With a parallel execution policy the lookups run on one thread per range of boxes and new keys are
+//  moved into the table by insert_parallel()
+
+//  Adds the keys of other
+    void merge_union(const ADS_set &other) { merge_union(std::execution::seq, other); }
+
+    template<typename ExecutionPolicy, typename = if_policy<ExecutionPolicy>>
+    void merge_union(ExecutionPolicy &&policy, const ADS_set &other);
+
+//  Erases the keys other doesn't have
+    void intersect(const ADS_set &other) { intersect(std::execution::seq, other); }
+
+    template<typename ExecutionPolicy, typename = if_policy<ExecutionPolicy>>
+    void intersect(ExecutionPolicy &&policy, const ADS_set &other);
+
+//  Erases the keys of other
+    void subtract(const ADS_set &other) { subtract(std::execution::seq, other); }
+
+    template<typename ExecutionPolicy, typename = if_policy<ExecutionPolicy>>
+    void subtract(ExecutionPolicy &&policy, const ADS_set &other);
+
+//  Erases the keys of other and adds the keys of other which were not there
+    void symmetric_difference(const ADS_set &other) { symmetric_difference(std::execution::seq, other); }
+
+    template<typename ExecutionPolicy, typename = if_policy<ExecutionPolicy>>
+    void symmetric_difference(ExecutionPolicy &&policy, const ADS_set &other);
+
+//  Returns an iterator to the first element. If ADS_set is empty it should return end-iterator
+    const_iterator begin() const;
+
+//  Returns an iterator to the "virtual" element after the last element of my ADS_set (end-iterator)
+    const_iterator end() const;
+
+//  Calls fn(key) for every key. Faster than a loop over the iterators, which check at every step whether the chain
+//  ends and the next box has to be searched
+    template<typename Fn>
+    void for_each(Fn fn) const {
+        for_each_in(0, box_count(), fn);
+    }
+
+//  for_each() with an execution policy. std::execution::seq runs on the calling thread, the parallel policies split
+//  the boxes into one range per core (sets with fewer than 16K boxes per thread use fewer threads). fn is called
+//  from several threads at the same time, the first exception it throws is rethrown after all threads are done
+    template<typename ExecutionPolicy, typename Fn, typename = if_policy<ExecutionPolicy>>
+    void for_each(ExecutionPolicy &&policy, Fn fn) const;
+
+//  All boxes of the set, for schedulers which split the work themselves (see Box_range). Ranges with at most grain
+//  boxes are not split any further
+    Box_range box_range(size_type grain = 1024) const { return Box_range{this, 0, box_count(), grain}; }
+
+//  Shows table in terminal
+    void dump(std::ostream &o = std::cerr) const;
+
+//  This method checks if my ADS_set is same as another ADS_set. Method should check table size, current size and each element.
+//  If everything is same it returns true, otherwise it returns false.
+    friend bool operator==(const ADS_set &lhs, const ADS_set &rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false; // if number of elements in lhs and rhs tables aren't same return false
+        }
+        if (lhs.digest() != rhs.digest()) {
+            return false; // different keys, no need to compare them one by one
+        }
+
+        for (const auto &elem: lhs) { // iterating through the lhs
+            if (rhs.count(elem) == 0) { // if one element in lhs isn't equal to the element in rhs ...
+                return false; // returning fale
+            }
+        }
+        return true; // if everything is equla returning true
+    }
+
+
+//  Like previous method but true and false are changed
+    friend bool operator!=(const ADS_set &lhs, const ADS_set &rhs) {
+        return !(lhs == rhs); // using reversed operator==
+    }
+};
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename... Args>
+typename ADS_set<Key, N, Traits, Allocator>::link_type
+ADS_set<Key, N, Traits, Allocator>::Node_pool::make(link_type next, Args &&... args) {
+    link_type l;
+    if (free_list) { // reusing an erased element
+        l = free_list;
+        free_list = *std::launder(static_cast<link_type *>(address(l)));
+        --free_count;
+    } else {
+        if (used == capacity) { // all slabs are used up
+            add_slab();
+        }
+        l = link_of(used);
+        ++used;
+    }
+    try {
+        construct(l, next, std::forward<Args>(args)...);
+    } catch (...) { // constructing the key failed, storage goes back to the free list
+        recycle(l);
+        throw;
+    }
+    return l;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+typename ADS_set<Key, N, Traits, Allocator>::size_type ADS_set<Key, N, Traits, Allocator>::Node_pool::carve(size_type count) {
+    if (count == 0) {
+        return used;
+    }
+    if constexpr (Traits::compact_links) {
+        if (used + count - 1 >= UINT32_MAX) {
+            throw std::length_error("ADS_set: more than 2^32 - 2 chain elements with compact links");
+        }
+    }
+    while (capacity - used < count) {
+        add_slab();
+    }
+    size_type first = used;
+    used += count;
+    return first;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+typename ADS_set<Key, N, Traits, Allocator>::Element *ADS_set<Key, N, Traits, Allocator>::add(size_type idx, size_type hash, K &&key) {
+    Element *added = place(idx, hash, std::forward<K>(key));
+    ++current_size; // increasing number of added elements
+    keys_digest.add(hash);
+    return added;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+typename ADS_set<Key, N, Traits, Allocator>::Element *ADS_set<Key, N, Traits, Allocator>::place(size_type idx, size_type hash, K &&key) {
+    Element *added;
+    if (table[idx].mode == Mode::used) { // if there is an element with same hash in the table
+        table[idx].next = pool.make(table[idx].next, std::forward<K>(key)); // new element from the pool is added to the existing list
+        added = node(table[idx].next);
+    } else { // if there is no collisions new element just adds to the ADS_set table
+        if constexpr (std::is_assignable<key_type &, K &&>::value) {
+            table[idx].key = std::forward<K>(key); // box with index idx now has key value
+        } else {
+            table[idx].key = key_type(std::forward<K>(key)); // a key of another type is converted first
+        }
+        table[idx].mode = Mode::used; // mode = used
+        table[idx].next = link_type{}; // this box has no references to the next element, because it's the only one element with this index
+        mark_used(idx);
+        added = &table[idx];
+    }
+    set_hash(*added, hash);
+    return added;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::prepare_insert() {
+    if (table_size == 0) { // table was moved away
+        rehash_to(N);
+        return;
+    }
+    if constexpr (Traits::incremental_rehash > 0) {
+        migrate(Traits::incremental_rehash); // every insert does a bit of a running rehash
+    }
+    if (current_size >= grow_at) { // the table is full at its load factor
+        size_type boxes = std::max(table_size + 1, boxes_for(current_size + 1)); // at least the next size of the policy
+        if constexpr (Traits::incremental_rehash > 0) {
+            start_migration(boxes); // keys stay in the old table for now
+        } else {
+            rehash_to(boxes);
+        }
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::shrink() {
+    // the load after shrinking is halfway between both load factors, so neither the next inserts nor erases rehash
+    double load = (static_cast<double>(min_load) + static_cast<double>(max_load)) / 2;
+    size_type boxes = growth_policy::round_up(
+            std::max(N, static_cast<size_type>(std::ceil(static_cast<double>(current_size) / load))));
+    if (boxes < table_size) {
+        try {
+            rehash_to(boxes);
+            compact_pool();
+        } catch (const std::bad_alloc &) { // rehash_to() and compact_pool() change nothing if they fail
+        }
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::compact_pool() {
+    if constexpr (std::is_nothrow_move_constructible_v<key_type>) {
+        if constexpr (Traits::incremental_rehash > 0) {
+            migrate(old.table_size); // chain elements of an old table are relinked first
+        }
+        size_type chained{current_size}; // keys which are not head keys
+        for (size_type w = 0; w < bitmap_words(table_size); ++w) {
+            chained -= static_cast<size_type>(__builtin_popcountll(occupied[w]));
+        }
+        if (!pool.oversized(chained)) {
+            return;
+        }
+        Node_pool fresh{get_allocator()};
+        fresh.reserve(chained); // the only allocation, nothing can fail after it
+        for (size_type n = 0; n < table_size; ++n) {
+            link_type *link = &table[n].next;
+            while (*link) { // every element is moved into the fresh pool, its next link is replaced in the next round
+                Element *element = node(*link);
+                link_type moved = fresh.make(element->next, std::move(element->key));
+                set_hash(*fresh.get(moved), cached_hash(*element));
+                pool.destroy(*link);
+                *link = moved;
+                link = &fresh.get(moved)->next;
+            }
+        }
+        pool.template swap<false>(fresh); // fresh releases the old slabs
+    }
+}
 
-//  This method swapped the elements of my container with the elements of another container
-    void swap(ADS_set &other);
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::max_load_factor(float ml) {
+    if (!(ml > 0.0f)) {
+        throw std::invalid_argument("ADS_set: max_load_factor has to be positive");
+    }
+    if (min_load * 2 >= ml) { // a grown table would shrink again right away
+        throw std::invalid_argument("ADS_set: max_load_factor has to be above 2 * min_load_factor");
+    }
+    max_load = ml;
+    set_limits();
+    reserve(current_size);
+}
 
-//  Returns an iterator to the first element. If ADS_set is empty it should return end-iterator
-    const_iterator begin() const;
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::min_load_factor(float ml) {
+    if (!(ml >= 0.0f)) {
+        throw std::invalid_argument("ADS_set: min_load_factor can't be negative");
+    }
+    if (ml * 2 >= max_load) { // a grown table would shrink again right away
+        throw std::invalid_argument("ADS_set: min_load_factor has to be below max_load_factor / 2");
+    }
+    min_load = ml;
+    set_limits();
+}
 
-//  Returns an iterator to the "virtual" element after the last element of my ADS_set (end-iterator)
-    const_iterator end() const;
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::reserve(size_type n) {
+    if (boxes_for(n) > table_size) { // if my table_size is smaller than I should make my table bigger.
+        rehash_to(boxes_for(n)); // rehash finds the right table size
+    }
+}
 
-//  Shows table in terminal
-    void dump(std::ostream &o = std::cerr) const;
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::rehash(size_type buckets) {
+    rehash_to(std::max({buckets, boxes_for(current_size), size_type{1}}));
+}
 
-//  This method checks if my ADS_set is same as another ADS_set. Method should check table size, current size and each element.
-//  If everything is same it returns true, otherwise it returns false.
-    friend bool operator==(const ADS_set &lhs, const ADS_set &rhs) {
-        if (lhs.size() != rhs.size()) {
-            return false; // if number of elements in lhs and rhs tables aren't same return false
-        }
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::shrink_to_fit() {
+    size_type boxes = growth_policy::round_up(std::max(N, boxes_for(current_size)));
+    if (boxes < table_size) {
+        rehash_to(boxes);
+    }
+    compact_pool();
+}
 
-        for (const auto &elem: lhs) { // iterating through the lhs
-            if (rhs.count(elem) == 0) { // if one element in lhs isn't equal to the element in rhs ...
-                return false; // returning fale
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::take_keys(ADS_set &other) {
+    max_load = other.max_load;
+    min_load = other.min_load;
+    set_limits();
+    reserve(other.current_size); // one resize instead of many
+    for (size_type i = 0; i < other.box_count(); ++i) {
+        if (other.box(i)->mode == Mode::used) {
+            for (Element *current = other.box(i); current; current = other.node(current->next)) {
+                prepare_insert();
+                size_type hash{other.hash_of(*current)};
+                add(h(hash), hash, std::move(current->key)); // keys of other are unique, no lookup needed
             }
         }
-        return true; // if everything is equla returning true
     }
+    other.clear(); // other only holds moved-from keys now
+}
 
 
-//  Like previous method but true and false are changed
-    friend bool operator!=(const ADS_set &lhs, const ADS_set &rhs) {
-        return !(lhs == rhs); // using reversed operator==
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+typename ADS_set<Key, N, Traits, Allocator>::Element *ADS_set<Key, N, Traits, Allocator>::locate(const K &key, size_type hash, size_type &idx) const {
+    if (table_size == 0) { // table was moved away
+        return nullptr;
     }
-};
-
-template<typename Key, size_t N>
-void ADS_set<Key, N>::add(const key_type &key) {
-    size_type idx{h(key)}; // receiving hash number from key
-    if (table[idx].mode == Mode::used) { // if there is an element with same hash in the table
-        auto *new_element = new Element{key, Mode::used, table[idx].next}; // creating a new element
-        table[idx].next = new_element; // new element is added to the existing list
-    } else { // if there is no collisions new element just adds to the ADS_set table
-        table[idx].key = key; // box with index idx now has key value
-        table[idx].mode = Mode::used; // mode = used
-        table[idx].next = nullptr; // this box has no references to the next element, because it's the only one element with this index
+    idx = h(hash);
+    Element *found = search(table[idx], key, hash);
+    if constexpr (Traits::incremental_rehash > 0) {
+        if (!found && old.table_size) { // key may still be in a box of the old table which is not moved yet
+            size_type old_idx{old.growth.index(hash)};
+            if (old_idx >= old.done) {
+                found = search(old.table[old_idx], key, hash);
+                idx = table_size + old_idx;
+            }
+        }
     }
-    ++current_size; // increasing number of added elements
+    return found;
 }
 
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ForwardIt, typename Fn>
+void ADS_set<Key, N, Traits, Allocator>::lookup_many(ForwardIt first, ForwardIt last, Fn found) const {
+    if (table_size == 0) { // table was moved away
+        for (; first != last; ++first) {
+            found(nullptr, 0);
+        }
+        return;
+    }
+    constexpr size_type distance = 16; // keys between hashing a key and comparing it, a power of two
+    size_type hashes[distance]; // ring of the hashes and boxes of keys [done, hashed)
+    Element *boxes[distance];
+    size_type hashed{0};
+    ForwardIt ahead = first;
+    for (size_type done{0}; first != last; ++first, ++done) {
+        for (; hashed < done + distance && ahead != last; ++ahead, ++hashed) { // 1. hashing, box is loaded meanwhile
+            size_type hash{full_hash(*ahead)};
+            hashes[hashed % distance] = hash;
+            boxes[hashed % distance] = &table[h(hash)];
+            __builtin_prefetch(boxes[hashed % distance]);
+        }
+        if (done + distance / 2 < hashed) { // 2. box is loaded by now, its first chain element is loaded next
+            __builtin_prefetch(node(boxes[(done + distance / 2) % distance]->next)); // nullptr is ignored
+        }
+        size_type hash{hashes[done % distance]}; // 3. comparing, mostly with cached elements
+        Element *element = search(*boxes[done % distance], *first, hash);
+        if (element) {
+            found(element, static_cast<size_type>(boxes[done % distance] - table));
+        } else if (old.table_size) { // the key may still be in the old table, the usual lookup checks that
+            size_type idx{0};
+            element = locate(*first, hash, idx);
+            found(element, idx);
+        } else {
+            found(nullptr, 0);
+        }
+    }
+}
 
-template<typename Key, size_t N>
-typename ADS_set<Key, N>::Element *ADS_set<Key, N>::locate(const key_type &key) const {
-    size_type idx{h(key)}; // receiving hash number from key
-    Element *ptr = &table[idx]; // creating a pointer, which points to the first element with index = idx of my table
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+typename ADS_set<Key, N, Traits, Allocator>::Element *
+ADS_set<Key, N, Traits, Allocator>::search(Element &head, const K &key, size_type hash) const {
+    Element *ptr = &head; // creating a pointer, which points to the first element of the box
     if (ptr->mode == Mode::used) { // if element that pointer points to is used...
         while (ptr) { // while pointer isn't equal to nullptr
-            if (key_equal{}(ptr->key,
-                            key)) { // if pointer ponts to the element and this element is equal to the key which is looking for
+            if (same_hash(*ptr, hash) && key_equal{}(ptr->key,
+                                                     key)) { // if pointer ponts to the element and this element is equal to the key which is looking for
                 return ptr; // method returns this pointer
             }
-            ptr = ptr->next; // if pointer points to the element which isn't equal to the key, pointer goes to the next element with same index (horizontal iteration)
+            ptr = node(ptr->next); // if pointer points to the element which isn't equal to the key, pointer goes to the next element with same index (horizontal iteration)
         }
     }
     return nullptr; // if there is no element in my table which is equal to the key, method returns nullptr
 }
 
-template<typename Key, size_t N>
-void ADS_set<Key, N>::reserve(size_type i) {
-    if (i > table_size) { // if my table_size is smaller than I should make my table bigger.
-        size_type new_table_size = table_size * 2; // making table size 2 times bigger.
-        while (new_table_size < i) { // while table size is smaller than i
-            new_table_size *= 2;     // table size doubles
-        }
-        rehash(new_table_size); // after finding right table size, table should be rehashed
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::rehash_to(size_type i) {
+    if constexpr (Traits::incremental_rehash > 0) {
+        migrate(old.table_size); // a running incremental rehash is finished first
     }
-}
-
-template<typename Key, size_t N>
-void ADS_set<Key, N>::rehash(size_type i) {
     Element *old_table = table; // copying my current table
     size_type old_table_size = table_size; // copying my current table size
-
-    table = new Element[i]; // overwriting my table with  new table size i
+    std::uint64_t *old_occupied = occupied;
+
+    i = growth_policy::round_up(i); // only sizes of the growth policy are used
+    if (!ADS_splits_boxes<growth_policy>::value || i < old_table_size) {
+        // head keys may collide in the new table and then need chain elements. They are reserved here, so nothing
+        // can fail once the keys start moving and a failed rehash leaves the set as it was
+        size_type heads{0};
+        for (size_type w = 0; w < bitmap_words(old_table_size); ++w) {
+            heads += static_cast<size_type>(__builtin_popcountll(occupied[w]));
+        }
+        pool.reserve(heads);
+    }
+    std::uint64_t *new_occupied = allocate_bitmap(i);
+    try {
+        table = allocate_table(i); // overwriting my table with  new table size i, the only allocation of a rehash
+    } catch (...) {
+        deallocate_bitmap(new_occupied, i);
+        throw;
+    }
     table_size = i; // overwriting my table size (vertical)
-    current_size = 0; // after overwriting number of elements in my overwritten table = 0
+    occupied = new_occupied;
+    first_used = i; // no box is used yet
+    growth.set_size(i); // h() now counts places in the new table, stored hashes are still valid
+    set_limits();
+    size_type collided{0}; // head keys whose new box was already taken by another head key
+    unsigned threads{rehash_threads(old_table_size)};
+
+    if (threads > 1) { // old boxes [a, b) only have keys for the new boxes [a * k, b * k), threads don't share boxes
+        std::vector<typename Node_pool::Free_list> freed(threads);
+        auto bound = [old_table_size, threads](unsigned t) { // multiples of 64, so threads don't share bitmap words
+            return t == threads ? old_table_size : old_table_size * t / threads / 64 * 64;
+        };
+        first_used = 0;
+        try {
+            run_parallel(threads, [&](unsigned t) {
+                for (size_type n = bound(t); n < bound(t + 1); ++n) {
+                    relink(old_table[n], &freed[t]);
+                }
+            });
+        } catch (...) {
+            reset_first_used();
+            for (auto &f: freed) {
+                pool.give_back(f);
+            }
+            throw;
+        }
+        reset_first_used();
+        for (auto &f: freed) {
+            pool.give_back(f);
+        }
+    } else {
+        for (size_type n = 0; n < old_table_size; ++n) { // iterating through my old table vertical
+            if (relink(old_table[n])) {
+                ++collided;
+            }
+        }
+    }
+    // two old boxes can only share a new box if the policy doesn't split boxes (ADS_prime_growth, shrinking).
+    // These heads need chain elements, the ones given back to the pool above are used first
+    for (size_type n = 0; collided > 0; ++n) {
+        if (old_table[n].mode == Mode::used) {
+            size_type hash{hash_of(old_table[n])};
+            place(h(hash), hash, std::move(old_table[n].key));
+            --collided;
+        }
+    }
+    deallocate_table(old_table, old_table_size); // deleting copy of my old table
+    deallocate_bitmap(old_occupied, old_table_size);
+}
 
-    for (size_type n = 0; n < old_table_size; ++n) { // iterating through my old table vertical
-        if (old_table[n].mode == Mode::used) { // if index has mode used
-            Element *current = &old_table[n];  // creating a pointer to an element with index n
-            while (current) {            // while current points to an element
-                add(current->key);  // adding this element to the overwritten table
-                current = current->next; // going to the next element in my old table (horizontal)
+template<typename Key, size_t N, typename Traits, typename Allocator>
+bool ADS_set<Key, N, Traits, Allocator>::relink(Element &head, typename Node_pool::Free_list *freed) {
+    bool waiting{false};
+    if (head.mode == Mode::used) { // head key moves into the table if its new box is free
+        size_type hash{hash_of(head)};
+        size_type idx{h(hash)};
+        if (table[idx].mode == Mode::free) {
+            place(idx, hash, std::move(head.key));
+            head.mode = Mode::free;
+        } else {
+            waiting = true;
+        }
+    }
+    link_type current = head.next; // chain elements are relinked, neither copied nor allocated
+    head.next = link_type{};
+    while (current) { // while current links to an element
+        Element *element = node(current);
+        link_type next = element->next; // remembering the next element in my old table (horizontal)
+        size_type idx{h(hash_of(*element))};
+        if (table[idx].mode == Mode::used) { // element is spliced into the chain of its new box
+            element->next = table[idx].next;
+            table[idx].next = current;
+        } else { // a box without head, the key moves into the table and the element goes back to the pool
+            place(idx, cached_hash(*element), std::move(element->key));
+            if (freed) {
+                pool.destroy(current, *freed);
+            } else {
+                pool.destroy(current);
             }
         }
+        current = next;
     }
-    for (size_type n = 0; n < old_table_size; ++n) { // iterating again through my old table
-        Element *current = old_table[n].next; // creating a pointer to an element with index n
-        while (current) { // while current points to an element
-            Element *next = current->next; // creating pointer to the next element in table (horizontal)
-            delete current; // delete current element
-            current = next; // going to the next element
+    return waiting;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+unsigned ADS_set<Key, N, Traits, Allocator>::rehash_threads(size_type old_table_size) const {
+    if constexpr (Traits::parallel_rehash > 0 && ADS_splits_boxes<growth_policy>::value) {
+        if (current_size < Traits::parallel_rehash || table_size < old_table_size) { // small, or shrinking
+            return 1;
         }
+        size_type most = old_table_size / 65536 + 1; // every thread relinks at least 64K boxes
+        return static_cast<unsigned>(std::min<size_type>(std::max(1u, std::thread::hardware_concurrency()), most));
+    } else {
+        static_cast<void>(old_table_size);
+        return 1;
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::start_migration(size_type i) {
+    migrate(old.table_size); // the last rehash has to be finished, normally it is
+    i = growth_policy::round_up(i);
+    std::uint64_t *new_occupied = allocate_bitmap(i);
+    Element *new_table;
+    try {
+        new_table = allocate_table(i);
+    } catch (...) {
+        deallocate_bitmap(new_occupied, i);
+        throw;
     }
-    delete[] old_table; // deleting copy of my old table
+    deallocate_bitmap(occupied, table_size); // the old table is searched without it
+    old = Migration{table, table_size, 0, growth};
+    table = new_table;
+    table_size = i;
+    occupied = new_occupied;
+    first_used = i;
+    growth.set_size(i);
+    set_limits();
 }
 
-template<typename Key, size_t N>
-ADS_set<Key, N>::ADS_set(const ADS_set &other) {
-    if (this->table_size != other.table_size) {
-        rehash(other.table_size);
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::migrate(size_type boxes) {
+    if (old.table_size == 0) { // no rehash is running
+        return;
+    }
+    for (; boxes > 0 && old.done < old.table_size; --boxes, ++old.done) {
+        Element &head = old.table[old.done];
+        if (relink(head)) { // head key gets a chain element, without waiting for other boxes
+            size_type hash{hash_of(head)};
+            place(h(hash), hash, std::move(head.key));
+            head.mode = Mode::free;
+        }
+    }
+    if (old.done == old.table_size) {
+        deallocate_table(old.table, old.table_size);
+        old = Migration{};
     }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator>::ADS_set(const ADS_set &other, const allocator_type &alloc)
+        : pool{alloc}, max_load{other.max_load}, min_load{other.min_load} {
+    rehash_to(other.table_size ? other.table_size : N); // same table size, so every key stays in its box
     for (size_type i = 0; i < other.table_size; ++i) { // iterating through other table (vertical)
         if (other.table[i].mode == Mode::used) { // if index is used
-            add(other.table[i].key);
-            Element *current_other = other.table[i].next; // creating pointer to the next element in other table
-            table[i].key = other.table[i].key; // copying key of element from other table to new table
+            place(i, cached_hash(other.table[i]), other.table[i].key);
+            Element *current_other = other.node(other.table[i].next); // creating pointer to the next element in other table
             while (current_other) { // iterating through the other table horizontal
-                add(current_other->key);
-                current_other = current_other->next;
+                place(i, cached_hash(*current_other), current_other->key);
+                current_other = other.node(current_other->next);
             }
         }
     }
+    for (size_type i = other.table_size; i < other.box_count(); ++i) { // keys of a running rehash of other
+        for (Element *current_other = other.box(i); current_other && current_other->mode == Mode::used;
+             current_other = other.node(current_other->next)) {
+            size_type hash{other.hash_of(*current_other)};
+            place(h(hash), hash, current_other->key);
+        }
+    }
+    current_size = other.current_size; // the same keys, without hashing them again for the digest
+    keys_digest = other.keys_digest;
 }
 
-template<typename Key, size_t N>
-ADS_set<Key, N>::~ADS_set() {
-    for (size_type i = 0; i < table_size; ++i) { // iterating through my table (vertical)
-        if (table[i].mode == Mode::used) { // if index has mode used
-            Element *current = table[i].next; // pointer to the next element in my table
-            while (current) { // while there are some elements in my table with same index (horizontal)
-                Element *temp = current; // pointer to the current element
-                current = current->next; // now current points to the next element
-                delete temp; // deleting element in table (horizontal)
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator>::ADS_set(ADS_set &&other, const allocator_type &alloc) : ADS_set(alloc) {
+    if (get_allocator() == other.get_allocator()) { // memory of other can be used by me
+        swap_storage<false>(other);
+    } else {
+        take_keys(other);
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator>::~ADS_set() {
+    if constexpr (!std::is_trivially_destructible<Element>::value) { // only keys like std::string need a walk
+        element_allocator a = pool.get_element_allocator();
+        for (size_type i = 0; i < box_count(); ++i) { // iterating through my table (vertical), and the old one
+            if (box(i)->mode == Mode::used) { // if index has mode used
+                Element *current = node(box(i)->next); // pointer to the next element in my table
+                while (current) { // while there are some elements in my table with same index (horizontal)
+                    Element *temp = current; // pointer to the current element
+                    current = node(current->next); // now current points to the next element
+                    element_traits::destroy(a, temp); // destroying key, the memory is released by the pool with its slabs
+                }
             }
         }
     }
-    delete[] table; // deleting memory used for table
+    deallocate_table(table, table_size); // deleting memory used for table
+    deallocate_table(old.table, old.table_size);
+    deallocate_bitmap(occupied, table_size);
 }
 
-template<typename Key, size_t N>
-ADS_set<Key, N> &ADS_set<Key, N>::operator=(const ADS_set &other) {
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator> &ADS_set<Key, N, Traits, Allocator>::operator=(const ADS_set &other) {
     if (this != &other) { // check if both tables are same
-        clear(); // completely delete my table
-        rehash(other.table_size);  // rehashing my table to pass to other table
-        for (size_type i = 0; i < other.table_size; ++i) { // iterating through other table
-            if (other.table[i].mode == Mode::used) { // if index has mode used
-                Element *current = &other.table[i]; // creating pointer to the element in other table
-                while (current) { // while there ara any elements (horizontal)
-                    add(current->key); // adding element from other table to my table
-                    current = current->next; // moving pointer to the next element
-                }
+        // copy is built with the allocator my table should have afterwards, then we take everything from it
+        ADS_set copy{other, alloc_traits::propagate_on_container_copy_assignment::value ? other.get_allocator()
+                                                                                        : get_allocator()};
+        swap_storage<alloc_traits::propagate_on_container_copy_assignment::value>(copy); // old table is deleted by copy with the allocator it was created with
+    }
+    return *this; // returning pointer to my table
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator> &ADS_set<Key, N, Traits, Allocator>::operator=(ADS_set &&other) noexcept(
+        alloc_traits::propagate_on_container_move_assignment::value || alloc_traits::is_always_equal::value) {
+    if (this != &other) {
+        if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
+            ADS_set taken{std::move(other)}; // my old table ends up in taken and is deleted with my old allocator
+            swap_storage<true>(taken);
+        } else {
+            if (alloc_traits::is_always_equal::value || get_allocator() == other.get_allocator()) {
+                ADS_set taken{std::move(other)};
+                swap_storage<false>(taken);
+            } else { // other's memory can't become mine, so only the keys are moved
+                ADS_set buffer{get_allocator()};
+                buffer.take_keys(other);
+                swap_storage<false>(buffer);
             }
         }
     }
-    return *this; // returning pointer to my table
+    return *this;
 }
 
-template<typename Key, size_t N>
-ADS_set<Key, N> &ADS_set<Key, N>::operator=(std::initializer_list<key_type> ilist) {
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator> &ADS_set<Key, N, Traits, Allocator>::operator=(std::initializer_list<key_type> ilist) {
     clear(); // completely delete my table
     insert(ilist); // insert ilist to my table
     return *this; // returning pointer to my table
 }
 
-template<typename Key, size_t N>
-std::pair<typename ADS_set<Key, N>::iterator, bool> ADS_set<Key, N>::insert(const key_type &key) {
-    Element *current_pos{locate(key)}; // finding a value in my table
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+std::pair<typename ADS_set<Key, N, Traits, Allocator>::iterator, bool> ADS_set<Key, N, Traits, Allocator>::insert_hashed(K &&key, size_type hash) {
+    size_type idx;
+    Element *current_pos{locate(key, hash, idx)}; // finding a value in my table
     if (current_pos) { // if value alredy in my table...
-        return {iterator(current_pos, table, h(key), table_size), false}; // returning iterator and bool
+        return {iterator(current_pos, storage(), idx), false}; // returning iterator and bool
     } else { // if value not found
-        if (static_cast<float>(current_size) / static_cast<float>(table_size) >= 0.7) { // checking load factor of my table
-            reserve(table_size * 2); // if table is overloaded making resizing 
+        prepare_insert(); // growing the table if it is overloaded
+        idx = h(hash); // table may have grown
+        Element *added = add(idx, hash, std::forward<K>(key)); // adding (or moving) value to the table
+        return {iterator(added, storage(), idx), true}; // returning itarator and bool
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+std::pair<typename ADS_set<Key, N, Traits, Allocator>::iterator, bool> ADS_set<Key, N, Traits, Allocator>::insert(const key_type &key) {
+    return insert_key(key);
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+std::pair<typename ADS_set<Key, N, Traits, Allocator>::iterator, bool> ADS_set<Key, N, Traits, Allocator>::insert(key_type &&key) {
+    return insert_key(std::move(key));
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename... Args>
+std::pair<typename ADS_set<Key, N, Traits, Allocator>::iterator, bool> ADS_set<Key, N, Traits, Allocator>::emplace(Args &&... args) {
+    if constexpr (sizeof...(Args) == 1 &&
+                  (std::is_same<std::remove_cv_t<std::remove_reference_t<Args>>, key_type>::value && ...)) {
+        return insert_key(std::forward<Args>(args)...); // key already exists, no need to build another one
+    } else {
+        link_type built = pool.make(link_type{}, std::forward<Args>(args)...); // key is built in a free chain element
+        size_type hash;
+        size_type idx;
+        Element *current_pos;
+        try {
+            hash = full_hash(node(built)->key);
+            current_pos = locate(node(built)->key, hash, idx);
+        } catch (...) {
+            pool.destroy(built);
+            throw;
+        }
+        if (current_pos) { // key is already there, element is not needed
+            pool.destroy(built);
+            return {iterator(current_pos, storage(), idx), false};
         }
-        add(key); // adding value to the table
-        return {iterator(locate(key), table, h(key), table_size), true}; // returning itarator and bool
+        try {
+            prepare_insert();
+        } catch (...) {
+            pool.destroy(built);
+            throw;
+        }
+        idx = h(hash);
+        if (table[idx].mode == Mode::used) { // element is linked into the chain as it is
+            set_hash(*node(built), hash);
+            node(built)->next = table[idx].next;
+            table[idx].next = built;
+            ++current_size;
+            keys_digest.add(hash);
+            return {iterator(node(built), storage(), idx), true};
+        }
+        Element *added = add(idx, hash, std::move(node(built)->key)); // box is free, key moves into the table
+        pool.destroy(built);
+        return {iterator(added, storage(), idx), true};
     }
 }
 
-template<typename Key, size_t N>
+template<typename Key, size_t N, typename Traits, typename Allocator>
 template<typename InputIt>
-void ADS_set<Key, N>::insert(InputIt first, InputIt last) {
+void ADS_set<Key, N, Traits, Allocator>::insert(InputIt first, InputIt last) {
+    using category = typename std::iterator_traits<InputIt>::iterator_category;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+        // the range can be walked twice: the table is grown once for all keys (duplicates included) ...
+        auto n = static_cast<size_type>(std::distance(first, last));
+        reserve(current_size + n);
+        if constexpr (std::is_same<std::decay_t<typename std::iterator_traits<InputIt>::reference>, key_type>::value) {
+            // ... and keys are inserted in blocks. The boxes of a whole block are hashed and prefetched first,
+            // so the cache misses of the block overlap instead of coming one after the other
+            constexpr size_type block = 16;
+            size_type hashes[block];
+            while (first != last) {
+                InputIt block_first = first;
+                size_type filled{0};
+                for (; filled < block && first != last; ++filled, ++first) {
+                    hashes[filled] = full_hash(*first);
+                    __builtin_prefetch(&table[h(hashes[filled])]);
+                }
+                for (size_type i = 0; i < filled; ++i, ++block_first) {
+                    insert_hashed(*block_first, hashes[i]);
+                }
+            }
+            return;
+        }
+    }
     for (auto it{first}; it != last; ++it) { // Iterate from the first element to the last element
         insert(*it);
     }
 }
 
-template<typename Key, size_t N>
-void ADS_set<Key, N>::clear() {
-    ADS_set buffer; // creating new default empty table
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename Fn>
+void ADS_set<Key, N, Traits, Allocator>::run_parallel(unsigned threads, Fn fn) {
+    std::vector<std::exception_ptr> errors(threads);
+    auto work = [&fn, &errors](unsigned t) {
+        try {
+            fn(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    unsigned t{1};
+    try {
+        for (; t < threads; ++t) {
+            workers.emplace_back(work, t);
+        }
+    } catch (const std::system_error &) { // no more threads available, the calling thread does the rest
+        for (; t < threads; ++t) {
+            work(t);
+        }
+    }
+    work(0);
+    for (auto &w: workers) {
+        w.join();
+    }
+    for (auto &e: errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename RandomIt>
+void ADS_set<Key, N, Traits, Allocator>::insert_parallel(RandomIt first, RandomIt last, unsigned threads) {
+    static_assert(std::is_base_of<std::random_access_iterator_tag,
+                          typename std::iterator_traits<RandomIt>::iterator_category>::value,
+                  "ADS_set: insert_parallel needs random access iterators");
+    auto n = static_cast<size_type>(last - first);
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if constexpr (!std::is_same<std::decay_t<typename std::iterator_traits<RandomIt>::reference>, key_type>::value) {
+        insert(first, last); // keys of other types are converted one by one
+    } else if (threads == 1 || n < size_type{4096} * threads) { // threads don't pay off
+        insert(first, last);
+    } else {
+        if constexpr (Traits::incremental_rehash > 0) {
+            migrate(old.table_size); // all keys have to be in the table
+        }
+        reserve(current_size + n);
+
+        unsigned parts{threads}; // partition p holds the boxes [p * part_boxes, (p + 1) * part_boxes)
+        size_type part_boxes = ((table_size + parts - 1) / parts + 63) / 64 * 64; // threads don't share bitmap words
+        auto slice = [n, threads](unsigned t) { return n * t / threads; }; // input slice of thread t starts here
+
+        // 1. every thread hashes its slice of the input and counts the keys per partition
+        std::vector<size_type> hashes(n);
+        std::vector<size_type> counts(size_type{threads} * parts);
+        run_parallel(threads, [&](unsigned t) {
+            size_type *count = &counts[size_type{t} * parts];
+            for (size_type i = slice(t); i < slice(t + 1); ++i) {
+                hashes[i] = full_hash(first[i]);
+                ++count[h(hashes[i]) / part_boxes];
+            }
+        });
+
+        // 2. radix partition: the keys of a partition end up next to each other, still in input order
+        std::vector<size_type> part_begin(parts + 1);
+        size_type offset{0};
+        for (unsigned p = 0; p < parts; ++p) {
+            part_begin[p] = offset;
+            for (unsigned t = 0; t < threads; ++t) { // counts become the write positions of the slices
+                size_type c = counts[size_type{t} * parts + p];
+                counts[size_type{t} * parts + p] = offset;
+                offset += c;
+            }
+        }
+        part_begin[parts] = offset;
+        std::vector<size_type> order(n);
+        run_parallel(threads, [&](unsigned t) {
+            size_type *pos = &counts[size_type{t} * parts];
+            for (size_type i = slice(t); i < slice(t + 1); ++i) {
+                order[pos[h(hashes[i]) / part_boxes]++] = i;
+            }
+        });
+
+        // 3. every thread fills the free boxes of its partition, the other new keys wait for a chain element.
+        // Keys added by a thread are counted even if another one throws, so the set stays consistent.
+        // first_used is found again afterwards, with 0 the threads never write it (see mark_used())
+        std::vector<std::vector<size_type>> waiting(parts);
+        std::vector<size_type> added(parts);
+        std::vector<ADS_set_digest> added_digest(parts);
+        auto count_added = [this, &added, &added_digest] {
+            for (unsigned p = 0; p < added.size(); ++p) {
+                current_size += added[p];
+                keys_digest += added_digest[p];
+                added[p] = 0;
+                added_digest[p] = ADS_set_digest{};
+            }
+        };
+        first_used = 0;
+        try {
+            run_parallel(threads, [&](unsigned p) {
+                size_type placed{0};
+                ADS_set_digest placed_digest;
+                try {
+                    for (size_type k = part_begin[p]; k < part_begin[p + 1]; ++k) {
+                        size_type i{order[k]};
+                        size_type idx{h(hashes[i])};
+                        if (table[idx].mode == Mode::free) { // only the head, the pool is not touched
+                            place(idx, hashes[i], first[i]);
+                            ++placed;
+                            placed_digest.add(hashes[i]);
+                        } else if (!same_hash(table[idx], hashes[i]) || !key_equal{}(table[idx].key, first[i])) {
+                            waiting[p].push_back(i);
+                        }
+                    }
+                } catch (...) {
+                    added[p] = placed;
+                    added_digest[p] = placed_digest;
+                    throw;
+                }
+                added[p] = placed;
+                added_digest[p] = placed_digest;
+            });
+        } catch (...) {
+            reset_first_used();
+            count_added();
+            throw;
+        }
+        reset_first_used();
+        count_added();
+
+        // 4. chain elements for all waiting keys are carved from the pool at once, every partition gets its own
+        // range of them. Elements left over by duplicates go to the free list afterwards
+        std::vector<size_type> carved(parts + 1);
+        for (unsigned p = 0; p < parts; ++p) {
+            carved[p + 1] = carved[p] + waiting[p].size();
+        }
+        size_type base = pool.carve(carved[parts]);
+        std::vector<size_type> consumed(parts);
+        auto recycle_rest = [this, &carved, &consumed, base, parts] {
+            for (unsigned p = 0; p < parts; ++p) {
+                for (size_type j = base + carved[p] + consumed[p]; j < base + carved[p + 1]; ++j) {
+                    pool.recycle(pool.link_at(j));
+                }
+            }
+        };
+        try {
+            run_parallel(threads, [&](unsigned p) {
+                size_type next{base + carved[p]};
+                size_type placed{0};
+                ADS_set_digest placed_digest;
+                try {
+                    for (size_type i: waiting[p]) {
+                        size_type idx{h(hashes[i])};
+                        if (search(table[idx], first[i], hashes[i])) { // duplicate in the range, or already in a chain
+                            continue;
+                        }
+                        link_type l = pool.link_at(next);
+                        pool.construct(l, table[idx].next, first[i]);
+                        ++next;
+                        set_hash(*node(l), hashes[i]);
+                        table[idx].next = l;
+                        ++placed;
+                        placed_digest.add(hashes[i]);
+                    }
+                } catch (...) {
+                    added[p] = placed;
+                    added_digest[p] = placed_digest;
+                    consumed[p] = next - (base + carved[p]);
+                    throw;
+                }
+                added[p] = placed;
+                added_digest[p] = placed_digest;
+                consumed[p] = next - (base + carved[p]);
+            });
+        } catch (...) {
+            count_added();
+            recycle_rest();
+            throw;
+        }
+        count_added();
+        recycle_rest();
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename Fn>
+void ADS_set<Key, N, Traits, Allocator>::for_each_in(size_type first, size_type last, Fn &fn) const {
+    for (size_type i = next_box(first); i < last; i = next_box(i + 1)) {
+        const Element *head = box(i);
+        fn(static_cast<const key_type &>(head->key));
+        for (const Element *e = node(head->next); e; e = node(e->next)) {
+            fn(static_cast<const key_type &>(e->key));
+        }
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy>
+unsigned ADS_set<Key, N, Traits, Allocator>::policy_threads(size_type boxes) {
+    if constexpr (std::is_same<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>::value) {
+        static_cast<void>(boxes);
+        return 1;
+    } else {
+        return static_cast<unsigned>(std::min<size_type>(std::max(1u, std::thread::hardware_concurrency()),
+                                                         boxes / 16384 + 1));
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy, typename Fn, typename>
+void ADS_set<Key, N, Traits, Allocator>::for_each(ExecutionPolicy &&, Fn fn) const {
+    size_type boxes = box_count();
+    unsigned threads{policy_threads<ExecutionPolicy>(boxes)};
+    if (threads == 1) {
+        for_each_in(0, boxes, fn);
+        return;
+    }
+    run_parallel(threads, [&](unsigned t) {
+        for_each_in(boxes * t / threads, boxes * (t + 1) / threads, fn);
+    });
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy>
+void ADS_set<Key, N, Traits, Allocator>::partition_keys(const ADS_set &other, std::vector<key_type> *found,
+                                                        std::vector<key_type> *missing) const {
+    size_type boxes = box_count();
+    unsigned threads{policy_threads<ExecutionPolicy>(boxes)};
+    std::vector<std::vector<key_type>> found_by(threads);
+    std::vector<std::vector<key_type>> missing_by(threads);
+    run_parallel(threads, [&](unsigned t) {
+        const_iterator first = first_from(boxes * t / threads);
+        const_iterator last = first_from(boxes * (t + 1) / threads);
+        const_iterator key = first; // lookup_many() reports the keys in order
+        other.lookup_many(first, last, [&](Element *element, size_type) {
+            if (element && found) {
+                found_by[t].push_back(*key);
+            } else if (!element && missing) {
+                missing_by[t].push_back(*key);
+            }
+            ++key;
+        });
+    });
+    auto join = [](std::vector<std::vector<key_type>> &parts, std::vector<key_type> *to) {
+        if (!to) {
+            return;
+        }
+        size_type n{0};
+        for (auto &part: parts) {
+            n += part.size();
+        }
+        to->reserve(to->size() + n);
+        for (auto &part: parts) {
+            std::move(part.begin(), part.end(), std::back_inserter(*to));
+        }
+    };
+    join(found_by, found);
+    join(missing_by, missing);
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy>
+void ADS_set<Key, N, Traits, Allocator>::insert_moved(std::vector<key_type> &keys) {
+    if constexpr (std::is_same<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>::value) {
+        insert(std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()));
+    } else {
+        insert_parallel(std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()));
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy, typename>
+void ADS_set<Key, N, Traits, Allocator>::merge_union(ExecutionPolicy &&policy, const ADS_set &other) {
+    if (other.size() > size()) { // my keys are looked up in other, the result is a copy of other
+        ADS_set result{other, get_allocator()};
+        result.use_limits_of(*this);
+        result.merge_union(policy, *this);
+        swap(result);
+        return;
+    }
+    std::vector<key_type> missing;
+    other.template partition_keys<ExecutionPolicy>(*this, nullptr, &missing);
+    insert_moved<ExecutionPolicy>(missing);
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy, typename>
+void ADS_set<Key, N, Traits, Allocator>::intersect(ExecutionPolicy &&policy, const ADS_set &other) {
+    if (other.size() < size()) { // the keys of other are looked up in my table, the result is a copy of other
+        ADS_set result{other, get_allocator()};
+        result.use_limits_of(*this);
+        result.intersect(policy, *this);
+        swap(result);
+        return;
+    }
+    std::vector<key_type> missing;
+    partition_keys<ExecutionPolicy>(other, nullptr, &missing);
+    for (const auto &key: missing) {
+        erase_key(key);
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy, typename>
+void ADS_set<Key, N, Traits, Allocator>::subtract(ExecutionPolicy &&, const ADS_set &other) {
+    std::vector<key_type> found; // keys of both sets, from the smaller one
+    if (other.size() < size()) {
+        other.template partition_keys<ExecutionPolicy>(*this, &found, nullptr);
+    } else {
+        partition_keys<ExecutionPolicy>(other, &found, nullptr);
+    }
+    for (const auto &key: found) {
+        erase_key(key);
+    }
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename ExecutionPolicy, typename>
+void ADS_set<Key, N, Traits, Allocator>::symmetric_difference(ExecutionPolicy &&policy, const ADS_set &other) {
+    if (other.size() > size()) { // my keys are looked up in other, the result is a copy of other
+        ADS_set result{other, get_allocator()};
+        result.use_limits_of(*this);
+        result.symmetric_difference(policy, *this);
+        swap(result);
+        return;
+    }
+    std::vector<key_type> found;
+    std::vector<key_type> missing;
+    other.template partition_keys<ExecutionPolicy>(*this, &found, &missing);
+    for (const auto &key: found) {
+        erase_key(key);
+    }
+    insert_moved<ExecutionPolicy>(missing);
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::clear() {
+    if (table_size == 0) { // table was moved away, there is nothing to keep
+        return;
+    }
+    element_allocator a = pool.get_element_allocator();
+    auto drop_chain = [this, &a](Element &head) { // keys of chain elements, their storage is reset with the pool
+        if constexpr (!std::is_trivially_destructible<Element>::value) {
+            for (Element *current = node(head.next); current;) {
+                Element *temp = current;
+                current = node(current->next);
+                element_traits::destroy(a, temp);
+            }
+        }
+        head.mode = Mode::free;
+        head.next = link_type{};
+    };
+    for (size_type w = first_used / 64; w < bitmap_words(table_size); ++w) {
+        for (std::uint64_t bits = occupied[w]; bits; bits &= bits - 1) { // only boxes with keys
+            drop_chain(table[w * 64 + static_cast<size_type>(__builtin_ctzll(bits))]);
+        }
+        occupied[w] = 0;
+    }
+    if constexpr (Traits::incremental_rehash > 0) {
+        if (old.table_size) { // the bigger table is kept, the old one is not needed any more
+            for (size_type i = old.done; i < old.table_size; ++i) {
+                if (old.table[i].mode == Mode::used) {
+                    drop_chain(old.table[i]);
+                }
+            }
+            deallocate_table(old.table, old.table_size);
+            old = Migration{};
+        }
+    }
+    static_cast<void>(a);
+    pool.reset();
+    first_used = table_size;
+    current_size = 0;
+    keys_digest = ADS_set_digest{};
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::clear_and_shrink() {
+    ADS_set buffer{get_allocator()}; // creating new default empty table with the same allocator
     swap(buffer); // replacing my table with buffer table.
 }
 
-template<typename Key, size_t N>
-typename ADS_set<Key, N>::size_type ADS_set<Key, N>::erase(const key_type &key) {
-    size_type idx{h(key)}; // finding element's place via hashing
-    Element *ptr = &table[idx]; // creating pointer to place in table with index = idx (place in table)
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+typename ADS_set<Key, N, Traits, Allocator>::size_type ADS_set<Key, N, Traits, Allocator>::erase_key(const K &key) {
+    if (table_size == 0) { // table was moved away
+        return 0;
+    }
+    if constexpr (Traits::incremental_rehash > 0) {
+        migrate(Traits::incremental_rehash); // every erase does a bit of a running rehash
+    }
+    size_type hash{full_hash(key)};
+    size_type idx{h(hash)};
+    if (erase_from(table[idx], key, hash)) {
+        if (table[idx].mode == Mode::free) { // the last key of the box
+            mark_free(idx);
+        }
+        shrink_if_sparse();
+        return 1;
+    }
+    if constexpr (Traits::incremental_rehash > 0) {
+        if (old.table_size) { // key may still be in a box of the old table which is not moved yet
+            size_type old_idx{old.growth.index(hash)};
+            if (old_idx >= old.done && erase_from(old.table[old_idx], key, hash)) {
+                shrink_if_sparse();
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+typename ADS_set<Key, N, Traits, Allocator>::size_type
+ADS_set<Key, N, Traits, Allocator>::erase_from(Element &head, const K &key, size_type hash) {
+    Element *ptr = &head; // creating pointer to the box
     if (ptr->mode == Mode::free) { // if this place is free
         return 0; // returning 0
     }
-    if (key_equal{}(ptr->key, key)) { // if pointer to a current element equals to an element we are searching
+    if (same_hash(*ptr, hash) && key_equal{}(ptr->key, key)) { // if pointer to a current element equals to an element we are searching
         if (ptr->next) { // checking if an element i want to delete has the next element
-            Element *toDelete = ptr->next; // creating pointer to an element i want to delete
-            ptr->key = toDelete->key;
-            ptr->next = toDelete->next;
-            delete toDelete;
+            link_type toDelete = ptr->next; // link to an element i want to delete
+            ptr->key = std::move(node(toDelete)->key); // next key moves into the box
+            set_hash(*ptr, cached_hash(*node(toDelete)));
+            ptr->next = node(toDelete)->next;
+            pool.destroy(toDelete);
         } else {
             ptr->mode = Mode::free;
         }
         --current_size;
+        keys_digest.remove(hash);
         return 1;
     }
     while (ptr->next) { // itereating horizontaly till finding an element
-        if (key_equal{}(ptr->next->key, key)) {
-            Element *toDelete = ptr->next;
-            ptr->next = toDelete->next;
-            delete toDelete;
+        if (same_hash(*node(ptr->next), hash) && key_equal{}(node(ptr->next)->key, key)) {
+            link_type toDelete = ptr->next;
+            ptr->next = node(toDelete)->next;
+            pool.destroy(toDelete);
             --current_size;
+            keys_digest.remove(hash);
             return 1;
         }
-        ptr = ptr->next;
+        ptr = node(ptr->next);
     }
     return 0;
 }
 
 
-template<typename Key, size_t N>
-typename ADS_set<Key, N>::iterator ADS_set<Key, N>::find(const key_type &key) const {
-    Element *location = locate(key); // setting pointer to element we're looking for
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<typename K>
+typename ADS_set<Key, N, Traits, Allocator>::iterator ADS_set<Key, N, Traits, Allocator>::find_key(const K &key) const {
+    size_type idx;
+    Element *location = locate(key, full_hash(key), idx); // setting pointer to element we're looking for
     if (location != nullptr) { // if pointer to the element we're looking isn't nullptr ..
-        return iterator(location, table, h(key),
-                        table_size); // returnting iterator which points to the element we're looking for
+        return iterator(location, storage(), idx); // returnting iterator which points to the element we're looking for
     }
     return end(); // if element isn't found returning end iterator
 }
 
-template<typename Key, size_t N>
-void ADS_set<Key, N>::swap(ADS_set &other) {
+template<typename Key, size_t N, typename Traits, typename Allocator>
+template<bool with_allocator>
+void ADS_set<Key, N, Traits, Allocator>::swap_storage(ADS_set &other) {
     std::swap(table, other.table); // swaping my table and other table
     std::swap(table_size, other.table_size); // swaping table sizes
+    std::swap(occupied, other.occupied);
+    std::swap(first_used, other.first_used);
     std::swap(current_size, other.current_size); // swapping numbers of elements in tables
+    std::swap(keys_digest, other.keys_digest);
+    std::swap(max_load, other.max_load); // load factors and their limits belong to the table
+    std::swap(min_load, other.min_load);
+    std::swap(grow_at, other.grow_at);
+    std::swap(shrink_at, other.shrink_at);
+    std::swap(growth, other.growth); // hash to box mapping belongs to the table
+    std::swap(old, other.old); // a running rehash too
+    pool.template swap<with_allocator>(other.pool); // chain elements belong to the table they are linked from
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+typename ADS_set<Key, N, Traits, Allocator>::Element *
+ADS_set<Key, N, Traits, Allocator>::allocate_table(size_type i) {
+    element_allocator a = pool.get_element_allocator();
+    Element *t = element_traits::allocate(a, i);
+    size_type constructed = 0;
+    try {
+        for (; constructed < i; ++constructed) { // every box starts free
+            element_traits::construct(a, t + constructed);
+        }
+    } catch (...) {
+        while (constructed > 0) {
+            element_traits::destroy(a, t + --constructed);
+        }
+        element_traits::deallocate(a, t, i);
+        throw;
+    }
+    return t;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::deallocate_table(Element *t, size_type i) {
+    if (!t) {
+        return;
+    }
+    element_allocator a = pool.get_element_allocator();
+    for (size_type n = 0; n < i; ++n) {
+        element_traits::destroy(a, t + n);
+    }
+    element_traits::deallocate(a, t, i);
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+std::uint64_t *ADS_set<Key, N, Traits, Allocator>::allocate_bitmap(size_type i) {
+    word_allocator a(pool.get_allocator());
+    std::uint64_t *bits = std::allocator_traits<word_allocator>::allocate(a, bitmap_words(i));
+    std::uninitialized_fill_n(bits, bitmap_words(i), std::uint64_t{0});
+    return bits;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::deallocate_bitmap(std::uint64_t *bits, size_type i) {
+    if (bits) {
+        word_allocator a(pool.get_allocator());
+        std::allocator_traits<word_allocator>::deallocate(a, bits, bitmap_words(i));
+    }
 }
 
-template<typename Key, size_t N>
-typename ADS_set<Key, N>::const_iterator ADS_set<Key, N>::begin() const {
-    for (size_type idx{0}; idx < table_size; ++idx) { // iterating through my table (vertical)
-        if (table[idx].mode == Mode::used) { // if index has mode used ..
-            return const_iterator(&table[idx], table, idx,
-                                  table_size); // returning const iterator pointing to the first element with index == idx
+template<typename Key, size_t N, typename Traits, typename Allocator>
+typename ADS_set<Key, N, Traits, Allocator>::size_type
+ADS_set<Key, N, Traits, Allocator>::Storage::next_used(size_type idx) const {
+    if (idx >= table_size) {
+        return table_size;
+    }
+    size_type w = idx / 64;
+    std::uint64_t bits = occupied[w] & (~std::uint64_t{0} << (idx % 64)); // boxes before idx don't count
+    size_type words = bitmap_words(table_size);
+    while (bits == 0) { // 64 free boxes at a time
+        if (++w == words) {
+            return table_size;
         }
+        bits = occupied[w];
+    }
+    return w * 64 + static_cast<size_type>(__builtin_ctzll(bits));
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+typename ADS_set<Key, N, Traits, Allocator>::size_type
+ADS_set<Key, N, Traits, Allocator>::Storage::next_box(size_type idx) const {
+    if (idx < table_size) {
+        idx = next_used(idx);
+    }
+    while (idx < box_count() && box(idx)->mode != Mode::used) { // boxes of the old table one by one
+        ++idx;
+    }
+    return idx;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+typename ADS_set<Key, N, Traits, Allocator>::const_iterator ADS_set<Key, N, Traits, Allocator>::begin() const {
+    if (first_used < table_size) {
+        return const_iterator(&table[first_used], storage(), first_used);
+    }
+    return first_from(table_size); // only an old table may still have keys
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+typename ADS_set<Key, N, Traits, Allocator>::const_iterator ADS_set<Key, N, Traits, Allocator>::first_from(size_type idx) const {
+    idx = next_box(idx);
+    if (idx < box_count()) {
+        return const_iterator(box(idx), storage(), idx); // returning const iterator pointing to the first element with index == idx
     }
     return end(); // if nothing was found returning end iterator
 }
 
-template<typename Key, size_t N>
-typename ADS_set<Key, N>::const_iterator ADS_set<Key, N>::end() const {
+template<typename Key, size_t N, typename Traits, typename Allocator>
+typename ADS_set<Key, N, Traits, Allocator>::const_iterator ADS_set<Key, N, Traits, Allocator>::end() const {
     return const_iterator(); // returning const iterator
 }
 
-template<typename Key, size_t N>
-void ADS_set<Key, N>::dump(std::ostream &o) const {
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void ADS_set<Key, N, Traits, Allocator>::dump(std::ostream &o) const {
     o << "Table size = " << table_size << ", Current size = " << current_size << "\n";
-    for (size_type idx{0}; idx < table_size; ++idx) {
+    if (old.table_size) {
+        o << "Rehashing, old table size = " << old.table_size << ", moved boxes = " << old.done
+          << ", boxes of the old table follow the table\n";
+    }
+    for (size_type idx{0}; idx < box_count(); ++idx) {
         o << idx << " : ";
-        if (table[idx].mode == Mode::free) {
+        if (box(idx)->mode == Mode::free) {
             o << "--Free\n";
         } else {
-            Element *node = &table[idx];
-            while (node) {
-                o << node->key;
-                node = node->next;
-                if (node) {
+            Element *elem = box(idx);
+            while (elem) {
+                o << elem->key;
+                elem = node(elem->next);
+                if (elem) {
                     o << " -> ";
                 }
             }
@@ -408,17 +2343,14 @@ void ADS_set<Key, N>::dump(std::ostream &o) const {
     }
 }
 
-template<typename Key, size_t N>
-class ADS_set<Key, N>::Iterator {
+template<typename Key, size_t N, typename Traits, typename Allocator>
+class ADS_set<Key, N, Traits, Allocator>::Iterator {
     Element *current_pos;
-    Element *table;
+    Storage storage; // tables and chain elements, not the set, so iterators survive swap() and moves of the set
     size_type idx;
-    size_type table_size;
 
     void skip() { // function to skip
-        while (table[idx].mode != Mode::used && table_size > idx) { // iterating through the table vertically till finding a used place
-            ++idx; // increaseing in index
-        }
+        idx = storage.next_box(idx); // free boxes of the table are skipped 64 at a time by the occupancy bitmap
     };
 
 public:
@@ -428,9 +2360,8 @@ public:
     using pointer = const value_type *;
     using iterator_category = std::forward_iterator_tag;
 
-    explicit Iterator(Element *current_pos = nullptr, Element *table = nullptr, size_type idx = 0,
-                      size_type table_size = N) : current_pos{current_pos}, table{table}, idx{idx},
-                                                  table_size{table_size} {}
+    explicit Iterator(Element *current_pos = nullptr, const Storage &storage = Storage{}, size_type idx = 0)
+            : current_pos{current_pos}, storage{storage}, idx{idx} {}
 
     reference operator*() const {
         return current_pos->key; // returning value of the current ponter
@@ -442,15 +2373,15 @@ public:
 
     Iterator &operator++() {
         if (current_pos && current_pos->next) { // if current positoin and next possitiong isnt null
-            current_pos = current_pos->next; // reassigning current possition
+            current_pos = storage.node(current_pos->next); // reassigning current possition
         } else { // if smth is null
             ++idx; // going to the next place (verticaly)
             skip(); // skiping in case current index is free
-            if (idx == table_size) { // if end of the table reached (vertically) 
+            if (idx == storage.box_count()) { // if end of the table reached (vertically)
                 current_pos = nullptr; // current position is null
                 return *this; // returning reference to a current iterator obj
             }
-            current_pos = &table[idx]; // updatin current positon to the next plece in hash table (verticaly)
+            current_pos = storage.box(idx); // updatin current positon to the next plece in hash table (verticaly)
         }
         return *this; // returning reference to a current iterator obj
     }
@@ -470,7 +2401,121 @@ public:
     }
 };
 
-template<typename Key, size_t N>
-void swap(ADS_set<Key, N> &lhs, ADS_set<Key, N> &rhs) { lhs.swap(rhs); }
+/*
+  Box_range is a range of boxes [first, last) of a set, for visiting the keys on many threads:
+  1. split() gives the upper half of the range to a new range, so a scheduler (e.g. a work-stealing pool) can
+     divide it recursively while is_divisible(). The constructor from a range and a split tag does the same, which
+     is the range concept of tbb::parallel_for.
+  2. for_each(fn) calls fn(key) for all keys of the boxes, like ADS_set::for_each().
+  Ranges stay valid as long as the set is not changed.
+*/
+template<typename Key, size_t N, typename Traits, typename Allocator>
+class ADS_set<Key, N, Traits, Allocator>::Box_range {
+    const ADS_set *set;
+    size_type first;
+    size_type last;
+    size_type grain;
+
+public:
+    Box_range(const ADS_set *set, size_type first, size_type last, size_type grain)
+            : set{set}, first{first}, last{last}, grain{std::max<size_type>(grain, 1)} {}
+
+//  Takes the upper half of other, other keeps the lower half
+    template<typename Split>
+    Box_range(Box_range &other, Split)
+            : set{other.set}, first{other.first + (other.last - other.first) / 2}, last{other.last},
+              grain{other.grain} {
+        other.last = first;
+    }
+
+    Box_range split() { return Box_range{*this, 0}; }
+
+    bool empty() const { return first == last; }
+
+    bool is_divisible() const { return last - first > grain; }
+
+//  Number of boxes, not of keys
+    size_type size() const { return last - first; }
+
+    size_type begin_box() const { return first; }
+
+    size_type end_box() const { return last; }
+
+    template<typename Fn>
+    void for_each(Fn fn) const { set->for_each_in(first, last, fn); }
+};
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+void swap(ADS_set<Key, N, Traits, Allocator> &lhs, ADS_set<Key, N, Traits, Allocator> &rhs) { lhs.swap(rhs); }
+
+//  Set algebra returning a new set. The bigger operand is copied for merge_union() and symmetric_difference(), the
+//  smaller one for intersect(), lhs for subtract(), and the other operand is applied in place (see ADS_set::intersect())
+template<typename ExecutionPolicy, typename Key, size_t N, typename Traits, typename Allocator,
+        typename = std::enable_if_t<std::is_execution_policy<std::decay_t<ExecutionPolicy>>::value>>
+ADS_set<Key, N, Traits, Allocator> merge_union(ExecutionPolicy &&policy, const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                               const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    bool lhs_bigger = lhs.size() >= rhs.size();
+    ADS_set<Key, N, Traits, Allocator> result{lhs_bigger ? lhs : rhs};
+    result.merge_union(policy, lhs_bigger ? rhs : lhs);
+    return result;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator> merge_union(const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                               const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    return merge_union(std::execution::seq, lhs, rhs);
+}
+
+template<typename ExecutionPolicy, typename Key, size_t N, typename Traits, typename Allocator,
+        typename = std::enable_if_t<std::is_execution_policy<std::decay_t<ExecutionPolicy>>::value>>
+ADS_set<Key, N, Traits, Allocator> intersect(ExecutionPolicy &&policy, const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                             const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    bool lhs_smaller = lhs.size() <= rhs.size();
+    ADS_set<Key, N, Traits, Allocator> result{lhs_smaller ? lhs : rhs};
+    result.intersect(policy, lhs_smaller ? rhs : lhs);
+    return result;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator> intersect(const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                             const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    return intersect(std::execution::seq, lhs, rhs);
+}
+
+template<typename ExecutionPolicy, typename Key, size_t N, typename Traits, typename Allocator,
+        typename = std::enable_if_t<std::is_execution_policy<std::decay_t<ExecutionPolicy>>::value>>
+ADS_set<Key, N, Traits, Allocator> subtract(ExecutionPolicy &&policy, const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                            const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    ADS_set<Key, N, Traits, Allocator> result{lhs};
+    result.subtract(policy, rhs);
+    return result;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator> subtract(const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                            const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    return subtract(std::execution::seq, lhs, rhs);
+}
+
+template<typename ExecutionPolicy, typename Key, size_t N, typename Traits, typename Allocator,
+        typename = std::enable_if_t<std::is_execution_policy<std::decay_t<ExecutionPolicy>>::value>>
+ADS_set<Key, N, Traits, Allocator> symmetric_difference(ExecutionPolicy &&policy,
+                                                        const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                                        const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    bool lhs_bigger = lhs.size() >= rhs.size();
+    ADS_set<Key, N, Traits, Allocator> result{lhs_bigger ? lhs : rhs};
+    result.symmetric_difference(policy, lhs_bigger ? rhs : lhs);
+    return result;
+}
+
+template<typename Key, size_t N, typename Traits, typename Allocator>
+ADS_set<Key, N, Traits, Allocator> symmetric_difference(const ADS_set<Key, N, Traits, Allocator> &lhs,
+                                                        const ADS_set<Key, N, Traits, Allocator> &rhs) {
+    return symmetric_difference(std::execution::seq, lhs, rhs);
+}
+
+//  ADS_set whose table and chain elements come from a std::pmr::memory_resource, e.g. a monotonic_buffer_resource
+template<typename Key, size_t N = 7, typename Traits = ADS_set_traits<Key>>
+using ADS_pmr_set = ADS_set<Key, N, Traits, std::pmr::polymorphic_allocator<Key>>;
 
 #endif // ADS_SET_H
\ No newline at end of file
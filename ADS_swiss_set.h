@@ -0,0 +1,552 @@
+#ifndef ADS_SWISS_SET_H
+#define ADS_SWISS_SET_H
+
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+#include "ADS_hash_mix.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+  ADS_swiss_set is an open-addressing alternative to the chaining ADS_set.
+  It has the same public interface, so a test or benchmark can switch the storage engine per instantiation.
+
+  Layout:
+  1. ctrl - one control byte per slot. Full slots store the low 7 bits of the hash (h2), free slots store
+     ctrl_empty or ctrl_deleted (both have the top bit set).
+  2. slots - flat array of keys, slot i belongs to ctrl[i]. Keys live only in full slots.
+  3. Slots are grouped in groups of group_width = 16. A whole group of control bytes is compared with one
+     SSE2 instruction (portable loop if SSE2 is not available).
+  4. The group number comes from the remaining hash bits (h1), collisions probe the next groups (triangular steps).
+*/
+template<typename Key, size_t N = 7>
+class ADS_swiss_set {
+public:
+    class Iterator;
+
+    using value_type = Key;
+    using key_type = Key;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_iterator = Iterator;
+    using iterator = const_iterator;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+
+private:
+    using ctrl_t = signed char;
+    using mask_t = std::uint32_t;
+
+    static constexpr ctrl_t ctrl_empty = -128; // slot never used since last rehash, lookups stop here
+    static constexpr ctrl_t ctrl_deleted = -2; // tombstone, lookups continue behind it
+    static constexpr size_type group_width = 16;
+
+//  Bitmask with one bit per slot of a group. Iterating yields the positions of set bits.
+    struct Group {
+        const ctrl_t *ctrl;
+
+        explicit Group(const ctrl_t *ctrl) : ctrl{ctrl} {}
+
+//      Slots whose control byte equals h2
+        mask_t match(ctrl_t h2) const {
+#if defined(__SSE2__)
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+            return static_cast<mask_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(h2))));
+#else
+            mask_t m{0};
+            for (size_type i = 0; i < group_width; ++i) {
+                if (ctrl[i] == h2) m |= mask_t{1} << i;
+            }
+            return m;
+#endif
+        }
+
+//      Slots which were never used
+        mask_t match_empty() const { return match(ctrl_empty); }
+
+//      Slots which are empty or deleted (top bit set)
+        mask_t match_free() const {
+#if defined(__SSE2__)
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+            return static_cast<mask_t>(_mm_movemask_epi8(c));
+#else
+            mask_t m{0};
+            for (size_type i = 0; i < group_width; ++i) {
+                if (ctrl[i] < 0) m |= mask_t{1} << i;
+            }
+            return m;
+#endif
+        }
+    };
+
+    static size_type lowest_bit(mask_t m) { return static_cast<size_type>(__builtin_ctz(m)); }
+
+//  Control bytes, one per slot
+    ctrl_t *ctrl{nullptr};
+
+//  Flat key storage. Only full slots hold a constructed key
+    key_type *slots{nullptr};
+
+//  Number of slots (groups * group_width), number of groups is a power of two
+    size_type capacity{0};
+
+//  Number of keys in the table
+    size_type current_size{0};
+
+//  Number of slots that can still turn from empty into full before the table has to grow (7/8 max load)
+    size_type growth_left{0};
+
+    static size_type h1(size_type hash) { return hash >> 7; }
+
+    static ctrl_t h2(size_type hash) { return static_cast<ctrl_t>(hash & 0x7F); }
+
+//  Returns slot index of key or capacity if key is not in the table
+    size_type locate(const key_type &key, size_type hash) const;
+
+//  Calls found(slot index or capacity) for every key of [first, last) in order, see count_many()
+    template<typename ForwardIt, typename Fn>
+    void lookup_many(ForwardIt first, ForwardIt last, Fn found) const;
+
+//  Returns first empty or deleted slot on the probe sequence of hash
+    size_type find_free(size_type hash) const;
+
+//  Writes control byte of slot i
+    void set_ctrl(size_type i, ctrl_t c) { ctrl[i] = c; }
+
+//  Allocates empty table with given number of slots
+    void allocate(size_type slot_count);
+
+//  Destroys keys and releases the arrays
+    void release();
+
+//  Rebuilds table with slot_count slots, drops all tombstones
+    void rehash(size_type slot_count);
+
+//  Makes room for one more key
+    void prepare_insert();
+
+//  Number of slots needed to hold n keys below max load
+    static size_type slots_for(size_type n);
+
+public:
+    ADS_swiss_set() { allocate(slots_for(N)); }
+
+    ADS_swiss_set(std::initializer_list<key_type> ilist) : ADS_swiss_set{} { insert(ilist); }
+
+    template<typename InputIt>
+    ADS_swiss_set(InputIt first, InputIt last): ADS_swiss_set() { insert(first, last); }
+
+    ADS_swiss_set(const ADS_swiss_set &other);
+
+    ~ADS_swiss_set() { release(); }
+
+    ADS_swiss_set &operator=(const ADS_swiss_set &other);
+
+    ADS_swiss_set &operator=(std::initializer_list<key_type> ilist);
+
+    size_type size() const { return current_size; }
+
+    bool empty() const { return current_size == 0; }
+
+    void insert(std::initializer_list<key_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    std::pair<iterator, bool> insert(const key_type &key);
+
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last);
+
+    void clear();
+
+//  Erased slot becomes empty if its group still has an empty slot (no probe sequence can run through it),
+//  otherwise it becomes a tombstone
+    size_type erase(const key_type &key);
+
+    size_type count(const key_type &key) const {
+        return locate(key, ADS_mix(hasher{}(key))) != capacity;
+    }
+
+    iterator find(const key_type &key) const;
+
+//  Batched count()/find() like ADS_set: a group of 16 keys is hashed and its control bytes and slots are prefetched
+//  before the first key is compared
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt count_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](size_type i) {
+            *out = size_type{i != capacity};
+            ++out;
+        });
+        return out;
+    }
+
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](size_type i) {
+            *out = i != capacity ? iterator(ctrl + i, slots + i, ctrl + capacity) : end();
+            ++out;
+        });
+        return out;
+    }
+
+    void swap(ADS_swiss_set &other);
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    void dump(std::ostream &o = std::cerr) const;
+
+    friend bool operator==(const ADS_swiss_set &lhs, const ADS_swiss_set &rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (const auto &elem: lhs) {
+            if (rhs.count(elem) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const ADS_swiss_set &lhs, const ADS_swiss_set &rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+template<typename Key, size_t N>
+typename ADS_swiss_set<Key, N>::size_type ADS_swiss_set<Key, N>::slots_for(size_type n) {
+    size_type groups{1};
+    while (groups * group_width * 7 / 8 < n) { // smallest power of two number of groups that keeps n below max load
+        groups *= 2;
+    }
+    return groups * group_width;
+}
+
+template<typename Key, size_t N>
+void ADS_swiss_set<Key, N>::allocate(size_type slot_count) {
+    ctrl_t *new_ctrl = new ctrl_t[slot_count];
+    try {
+        slots = std::allocator<key_type>{}.allocate(slot_count);
+    } catch (...) {
+        delete[] new_ctrl;
+        throw;
+    }
+    ctrl = new_ctrl;
+    std::memset(ctrl, static_cast<unsigned char>(ctrl_empty), slot_count);
+    capacity = slot_count;
+    current_size = 0;
+    growth_left = slot_count * 7 / 8;
+}
+
+template<typename Key, size_t N>
+void ADS_swiss_set<Key, N>::release() {
+    for (size_type i = 0; i < capacity; ++i) {
+        if (ctrl[i] >= 0) { // full slot
+            slots[i].~key_type();
+        }
+    }
+    if (slots) {
+        std::allocator<key_type>{}.deallocate(slots, capacity);
+    }
+    delete[] ctrl;
+    ctrl = nullptr;
+    slots = nullptr;
+    capacity = 0;
+    current_size = 0;
+    growth_left = 0;
+}
+
+template<typename Key, size_t N>
+typename ADS_swiss_set<Key, N>::size_type ADS_swiss_set<Key, N>::locate(const key_type &key, size_type hash) const {
+    size_type group_mask = capacity / group_width - 1;
+    size_type g = h1(hash) & group_mask;
+    ctrl_t tag = h2(hash);
+    for (size_type step = 1; step <= group_mask + 1; ++step) { // every group is visited at most once
+        Group group{ctrl + g * group_width};
+        for (mask_t m = group.match(tag); m; m &= m - 1) { // only slots with matching 7-bit tag are compared
+            size_type i = g * group_width + lowest_bit(m);
+            if (key_equal{}(slots[i], key)) {
+                return i;
+            }
+        }
+        if (group.match_empty()) { // key would have been placed in this group
+            return capacity;
+        }
+        g = (g + step) & group_mask; // triangular probing visits all groups for power of two counts
+    }
+    return capacity;
+}
+
+template<typename Key, size_t N>
+template<typename ForwardIt, typename Fn>
+void ADS_swiss_set<Key, N>::lookup_many(ForwardIt first, ForwardIt last, Fn found) const {
+    constexpr size_type batch = 16;
+    size_type hashes[batch];
+    size_type group_mask = capacity / group_width - 1;
+    while (first != last) {
+        ForwardIt batch_first = first;
+        size_type filled{0};
+        for (; filled < batch && first != last; ++filled, ++first) {
+            hashes[filled] = ADS_mix(hasher{}(*first));
+            size_type g = h1(hashes[filled]) & group_mask;
+            __builtin_prefetch(ctrl + g * group_width);
+            __builtin_prefetch(slots + g * group_width);
+        }
+        for (size_type i = 0; i < filled; ++i, ++batch_first) {
+            found(locate(*batch_first, hashes[i]));
+        }
+    }
+}
+
+template<typename Key, size_t N>
+typename ADS_swiss_set<Key, N>::size_type ADS_swiss_set<Key, N>::find_free(size_type hash) const {
+    size_type group_mask = capacity / group_width - 1;
+    size_type g = h1(hash) & group_mask;
+    for (size_type step = 1;; ++step) { // growth_left guarantees a free slot
+        mask_t m = Group{ctrl + g * group_width}.match_free();
+        if (m) {
+            return g * group_width + lowest_bit(m);
+        }
+        g = (g + step) & group_mask;
+    }
+}
+
+template<typename Key, size_t N>
+void ADS_swiss_set<Key, N>::rehash(size_type slot_count) {
+    ctrl_t *old_ctrl = ctrl;
+    key_type *old_slots = slots;
+    size_type old_capacity = capacity;
+    size_type old_size = current_size;
+
+    allocate(slot_count);
+    for (size_type i = 0; i < old_capacity; ++i) {
+        if (old_ctrl[i] >= 0) {
+            size_type hash = ADS_mix(hasher{}(old_slots[i]));
+            size_type j = find_free(hash);
+            ::new(static_cast<void *>(slots + j)) key_type(std::move(old_slots[i])); // keys are moved, not copied
+            set_ctrl(j, h2(hash));
+            old_slots[i].~key_type();
+        }
+    }
+    current_size = old_size;
+    growth_left -= old_size;
+
+    std::allocator<key_type>{}.deallocate(old_slots, old_capacity);
+    delete[] old_ctrl;
+}
+
+template<typename Key, size_t N>
+void ADS_swiss_set<Key, N>::prepare_insert() {
+    if (growth_left > 0) {
+        return;
+    }
+    if (current_size * 32 <= capacity * 25) { // mostly tombstones, cleaning them up in place is enough
+        rehash(capacity);
+    } else {
+        rehash(capacity * 2);
+    }
+}
+
+template<typename Key, size_t N>
+ADS_swiss_set<Key, N>::ADS_swiss_set(const ADS_swiss_set &other) {
+    allocate(other.capacity);
+    for (size_type i = 0; i < other.capacity; ++i) { // same capacity, so every key keeps its slot
+        if (other.ctrl[i] >= 0) {
+            ::new(static_cast<void *>(slots + i)) key_type(other.slots[i]);
+            set_ctrl(i, other.ctrl[i]);
+            ++current_size;
+        } else if (other.ctrl[i] == ctrl_deleted) {
+            set_ctrl(i, ctrl_deleted); // keeps probe sequences intact
+        }
+    }
+    growth_left = other.growth_left;
+}
+
+template<typename Key, size_t N>
+ADS_swiss_set<Key, N> &ADS_swiss_set<Key, N>::operator=(const ADS_swiss_set &other) {
+    if (this != &other) {
+        ADS_swiss_set copy{other};
+        swap(copy);
+    }
+    return *this;
+}
+
+template<typename Key, size_t N>
+ADS_swiss_set<Key, N> &ADS_swiss_set<Key, N>::operator=(std::initializer_list<key_type> ilist) {
+    clear();
+    insert(ilist);
+    return *this;
+}
+
+template<typename Key, size_t N>
+std::pair<typename ADS_swiss_set<Key, N>::iterator, bool> ADS_swiss_set<Key, N>::insert(const key_type &key) {
+    size_type hash = ADS_mix(hasher{}(key)); // hashing only once
+    size_type i = locate(key, hash);
+    if (i != capacity) {
+        return {iterator(ctrl + i, slots + i, ctrl + capacity), false};
+    }
+    prepare_insert();
+    i = find_free(hash);
+    ::new(static_cast<void *>(slots + i)) key_type(key);
+    if (ctrl[i] == ctrl_empty) { // reusing a tombstone does not use up growth
+        --growth_left;
+    }
+    set_ctrl(i, h2(hash));
+    ++current_size;
+    return {iterator(ctrl + i, slots + i, ctrl + capacity), true};
+}
+
+template<typename Key, size_t N>
+template<typename InputIt>
+void ADS_swiss_set<Key, N>::insert(InputIt first, InputIt last) {
+    for (auto it{first}; it != last; ++it) {
+        insert(*it);
+    }
+}
+
+template<typename Key, size_t N>
+void ADS_swiss_set<Key, N>::clear() {
+    ADS_swiss_set buffer;
+    swap(buffer);
+}
+
+template<typename Key, size_t N>
+typename ADS_swiss_set<Key, N>::size_type ADS_swiss_set<Key, N>::erase(const key_type &key) {
+    size_type i = locate(key, ADS_mix(hasher{}(key)));
+    if (i == capacity) {
+        return 0;
+    }
+    slots[i].~key_type();
+    if (Group{ctrl + i / group_width * group_width}.match_empty()) { // probing always stops in this group anyway
+        set_ctrl(i, ctrl_empty);
+        ++growth_left;
+    } else {
+        set_ctrl(i, ctrl_deleted);
+    }
+    --current_size;
+    return 1;
+}
+
+template<typename Key, size_t N>
+typename ADS_swiss_set<Key, N>::iterator ADS_swiss_set<Key, N>::find(const key_type &key) const {
+    size_type i = locate(key, ADS_mix(hasher{}(key)));
+    if (i != capacity) {
+        return iterator(ctrl + i, slots + i, ctrl + capacity);
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+void ADS_swiss_set<Key, N>::swap(ADS_swiss_set &other) {
+    std::swap(ctrl, other.ctrl);
+    std::swap(slots, other.slots);
+    std::swap(capacity, other.capacity);
+    std::swap(current_size, other.current_size);
+    std::swap(growth_left, other.growth_left);
+}
+
+template<typename Key, size_t N>
+typename ADS_swiss_set<Key, N>::const_iterator ADS_swiss_set<Key, N>::begin() const {
+    for (size_type g = 0; g < capacity; g += group_width) { // skipping whole free groups at once
+        mask_t full = ~Group{ctrl + g}.match_free() & 0xFFFF;
+        if (full) {
+            size_type i = g + lowest_bit(full);
+            return const_iterator(ctrl + i, slots + i, ctrl + capacity);
+        }
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+typename ADS_swiss_set<Key, N>::const_iterator ADS_swiss_set<Key, N>::end() const {
+    return const_iterator();
+}
+
+template<typename Key, size_t N>
+void ADS_swiss_set<Key, N>::dump(std::ostream &o) const {
+    o << "Capacity = " << capacity << ", Current size = " << current_size << ", Growth left = " << growth_left
+      << "\n";
+    for (size_type i = 0; i < capacity; ++i) {
+        if (i % group_width == 0) {
+            o << "-- group " << i / group_width << "\n";
+        }
+        o << i << " : ";
+        if (ctrl[i] == ctrl_empty) {
+            o << "--Empty\n";
+        } else if (ctrl[i] == ctrl_deleted) {
+            o << "--Deleted\n";
+        } else {
+            o << slots[i] << " (h2 = " << static_cast<int>(ctrl[i]) << ")\n";
+        }
+    }
+}
+
+template<typename Key, size_t N>
+class ADS_swiss_set<Key, N>::Iterator {
+    const ctrl_t *ctrl;
+    const key_type *slot;
+    const ctrl_t *ctrl_end;
+
+    void skip() { // moving to the next full slot or to end
+        while (ctrl != ctrl_end && *ctrl < 0) {
+            ++ctrl;
+            ++slot;
+        }
+        if (ctrl == ctrl_end) {
+            slot = nullptr;
+        }
+    }
+
+public:
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using pointer = const value_type *;
+    using iterator_category = std::forward_iterator_tag;
+
+    explicit Iterator(const ctrl_t *ctrl = nullptr, const key_type *slot = nullptr, const ctrl_t *ctrl_end = nullptr)
+            : ctrl{ctrl}, slot{slot}, ctrl_end{ctrl_end} {}
+
+    reference operator*() const {
+        return *slot;
+    }
+
+    pointer operator->() const {
+        return slot;
+    }
+
+    Iterator &operator++() {
+        ++ctrl;
+        ++slot;
+        skip();
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        auto ret_code{*this};
+        ++*this;
+        return ret_code;
+    }
+
+    friend bool operator==(const Iterator &lhs, const Iterator &rhs) {
+        return lhs.slot == rhs.slot;
+    }
+
+    friend bool operator!=(const Iterator &lhs, const Iterator &rhs) {
+        return !(lhs.slot == rhs.slot);
+    }
+};
+
+template<typename Key, size_t N>
+void swap(ADS_swiss_set<Key, N> &lhs, ADS_swiss_set<Key, N> &rhs) { lhs.swap(rhs); }
+
+#endif // ADS_SWISS_SET_H
@@ -0,0 +1,557 @@
+#ifndef ADS_UNROLLED_SET_H
+#define ADS_UNROLLED_SET_H
+
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cstdint>
+
+#include "ADS_hash_mix.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+  ADS_unrolled_set is a chaining set like ADS_set, but its chains are unrolled: every box of the table and every
+  overflow node is a cache line sized Block holding several keys. It has the same public interface as ADS_set.
+
+  Layout:
+  1. Block - block_keys keys (as many as fit into 64 bytes next to the count and the link, at least one),
+     the number of keys in the block and a link to the next Block of the chain. The count sits right behind the
+     keys, so only the link is padded and the whole block is one cache line.
+  2. Keys of a block are compacted: slots [0, count) are used. erase() moves the last key of the block into the
+     hole, an overflow block is deleted when it gets empty.
+  3. A lookup compares all keys of a block after one cache miss. 4 and 8 byte integer keys are compared with SSE2.
+  4. Number of boxes is a power of two, the mixed hash selects the box. The table grows when the blocks of the
+     table are 3/4 full on average.
+*/
+template<typename Key, size_t N = 7>
+class ADS_unrolled_set {
+public:
+    class Iterator;
+
+    using value_type = Key;
+    using key_type = Key;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using const_iterator = Iterator;
+    using iterator = const_iterator;
+    using key_equal = std::equal_to<key_type>;
+    using hasher = std::hash<key_type>;
+
+private:
+    using mask_t = std::uint64_t;
+
+    static constexpr size_type line_size = 64;
+    static constexpr size_type header_size = sizeof(void *) + 1; // the count and the link, which ends the line
+    static constexpr size_type block_keys = sizeof(key_type) + header_size < line_size
+                                            ? (line_size - header_size) / sizeof(key_type) : 1;
+    static_assert(block_keys < 64, "ADS_unrolled_set: one mask_t bit per key of a block");
+
+    struct alignas(line_size) Block {
+        alignas(key_type) unsigned char storage[block_keys * sizeof(key_type)]; // keys [0, count) are constructed
+        std::uint8_t count{0};
+        Block *next{nullptr};
+
+        key_type *keys() { return std::launder(reinterpret_cast<key_type *>(storage)); }
+
+        const key_type *keys() const { return std::launder(reinterpret_cast<const key_type *>(storage)); }
+    };
+    static_assert(sizeof(Block) == line_size || block_keys == 1, "ADS_unrolled_set: a Block is one cache line");
+
+//  Integer keys of 4 or 8 bytes compare equal if their bytes are equal, so a block is matched with SSE2
+    static constexpr bool simd_keys = std::is_integral<key_type>::value &&
+                                      (sizeof(key_type) == 4 || sizeof(key_type) == 8);
+
+//  Table of the first blocks of the chains
+    Block *table{nullptr};
+
+//  Number of boxes, a power of two
+    size_type table_size{0};
+
+//  Number of keys in the set
+    size_type current_size{0};
+
+//  Box of key, from the mixed hash (see ADS_mix())
+    size_type h(const key_type &key) const { return ADS_mix(hasher{}(key)) & (table_size - 1); }
+
+//  Used slots of block whose key equals key, bit i for slot i
+    static mask_t match(const Block &block, const key_type &key);
+
+//  Finds key in the chain of box idx, returns its block and sets slot (nullptr if key is not there)
+    Block *locate(const key_type &key, size_type idx, size_type &slot) const;
+
+//  Adds a key which is not in the set to box idx, returns its block and sets slot
+    template<typename K>
+    Block *add(size_type idx, K &&key, size_type &slot);
+
+//  Deletes all overflow blocks and keys, the table itself stays
+    void destroy_keys();
+
+//  Rebuilds the table with boxes boxes, keys are moved
+    void rehash(size_type boxes);
+
+//  Makes room for one more key
+    void prepare_insert();
+
+//  Calls found(block, idx, slot) for every key of [first, last) in order, see count_many()
+    template<typename ForwardIt, typename Fn>
+    void lookup_many(ForwardIt first, ForwardIt last, Fn found) const;
+
+//  Number of boxes needed to hold n keys below max load
+    static size_type boxes_for(size_type n);
+
+public:
+    ADS_unrolled_set() { rehash(boxes_for(N)); }
+
+    ADS_unrolled_set(std::initializer_list<key_type> ilist) : ADS_unrolled_set{} { insert(ilist); }
+
+    template<typename InputIt>
+    ADS_unrolled_set(InputIt first, InputIt last): ADS_unrolled_set() { insert(first, last); }
+
+    ADS_unrolled_set(const ADS_unrolled_set &other);
+
+    ~ADS_unrolled_set() {
+        destroy_keys();
+        delete[] table;
+    }
+
+    ADS_unrolled_set &operator=(const ADS_unrolled_set &other);
+
+    ADS_unrolled_set &operator=(std::initializer_list<key_type> ilist);
+
+    size_type size() const { return current_size; }
+
+    bool empty() const { return current_size == 0; }
+
+    void insert(std::initializer_list<key_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    std::pair<iterator, bool> insert(const key_type &key);
+
+    template<typename InputIt>
+    void insert(InputIt first, InputIt last);
+
+    void clear();
+
+//  The last key of the block moves into the hole, an empty overflow block is deleted and an empty first block
+//  takes the keys of the next block
+    size_type erase(const key_type &key);
+
+    size_type count(const key_type &key) const {
+        size_type slot;
+        return locate(key, h(key), slot) != nullptr;
+    }
+
+    iterator find(const key_type &key) const;
+
+//  Batched count()/find() like ADS_set: the first block of a key is prefetched 16 keys before it is compared
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt count_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [&out](const Block *block, size_type, size_type) {
+            *out = size_type{block != nullptr};
+            ++out;
+        });
+        return out;
+    }
+
+    template<typename ForwardIt, typename OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        lookup_many(first, last, [this, &out](const Block *block, size_type idx, size_type slot) {
+            *out = block ? iterator(table, table_size, idx, block, slot) : end();
+            ++out;
+        });
+        return out;
+    }
+
+    void swap(ADS_unrolled_set &other);
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
+
+    void dump(std::ostream &o = std::cerr) const;
+
+    friend bool operator==(const ADS_unrolled_set &lhs, const ADS_unrolled_set &rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (const auto &elem: lhs) {
+            if (rhs.count(elem) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const ADS_unrolled_set &lhs, const ADS_unrolled_set &rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+template<typename Key, size_t N>
+typename ADS_unrolled_set<Key, N>::size_type ADS_unrolled_set<Key, N>::boxes_for(size_type n) {
+    size_type boxes{1};
+    while (boxes * block_keys * 3 / 4 < n) { // smallest power of two that keeps n below max load
+        boxes *= 2;
+    }
+    return boxes;
+}
+
+template<typename Key, size_t N>
+typename ADS_unrolled_set<Key, N>::mask_t ADS_unrolled_set<Key, N>::match(const Block &block, const key_type &key) {
+    mask_t used = (mask_t{1} << block.count) - 1;
+#if defined(__SSE2__)
+    if constexpr (simd_keys) {
+        // whole 16 byte chunks of the block are compared, chunks may reach into count and next but stay in the block
+        constexpr size_type per_chunk = 16 / sizeof(key_type);
+        constexpr size_type chunks = (block_keys + per_chunk - 1) / per_chunk;
+        static_assert(chunks * 16 <= sizeof(Block), "ADS_unrolled_set: SIMD chunks must stay inside the block");
+        __m128i wanted;
+        if constexpr (sizeof(key_type) == 4) {
+            wanted = _mm_set1_epi32(static_cast<int>(key));
+        } else {
+            wanted = _mm_set1_epi64x(static_cast<long long>(key));
+        }
+        mask_t m{0};
+        for (size_type c = 0; c < chunks; ++c) {
+            __m128i keys = _mm_load_si128(reinterpret_cast<const __m128i *>(block.storage) + c);
+            __m128i equal = _mm_cmpeq_epi32(keys, wanted);
+            if constexpr (sizeof(key_type) == 4) {
+                m |= static_cast<mask_t>(_mm_movemask_ps(_mm_castsi128_ps(equal))) << (c * 4);
+            } else { // both 32 bit halves have to be equal
+                equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+                m |= static_cast<mask_t>(_mm_movemask_pd(_mm_castsi128_pd(equal))) << (c * 2);
+            }
+        }
+        return m & used;
+    }
+#endif
+    mask_t m{0};
+    const key_type *keys = block.keys();
+    for (size_type i = 0; i < block.count; ++i) {
+        if (key_equal{}(keys[i], key)) {
+            m |= mask_t{1} << i;
+        }
+    }
+    return m & used;
+}
+
+template<typename Key, size_t N>
+typename ADS_unrolled_set<Key, N>::Block *
+ADS_unrolled_set<Key, N>::locate(const key_type &key, size_type idx, size_type &slot) const {
+    for (Block *block = &table[idx]; block; block = block->next) { // one cache line per block
+        mask_t m = match(*block, key);
+        if (m) {
+            slot = static_cast<size_type>(__builtin_ctzll(m));
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+template<typename Key, size_t N>
+template<typename K>
+typename ADS_unrolled_set<Key, N>::Block *ADS_unrolled_set<Key, N>::add(size_type idx, K &&key, size_type &slot) {
+    Block *block = &table[idx];
+    while (block->count == block_keys) { // first block with a free slot, a new one at the end of the chain
+        if (!block->next) {
+            block->next = new Block;
+        }
+        block = block->next;
+    }
+    slot = block->count;
+    ::new(static_cast<void *>(block->keys() + slot)) key_type(std::forward<K>(key));
+    ++block->count;
+    ++current_size;
+    return block;
+}
+
+template<typename Key, size_t N>
+void ADS_unrolled_set<Key, N>::destroy_keys() {
+    for (size_type i = 0; i < table_size; ++i) {
+        Block *block = &table[i];
+        while (block) {
+            Block *next = block->next;
+            std::destroy_n(block->keys(), block->count);
+            if (block != &table[i]) {
+                delete block;
+            }
+            block = next;
+        }
+        table[i].next = nullptr;
+        table[i].count = 0;
+    }
+    current_size = 0;
+}
+
+template<typename Key, size_t N>
+void ADS_unrolled_set<Key, N>::rehash(size_type boxes) {
+    Block *old_table = table;
+    size_type old_table_size = table_size;
+
+    table = new Block[boxes];
+    table_size = boxes;
+    current_size = 0;
+    for (size_type i = 0; i < old_table_size; ++i) {
+        Block *block = &old_table[i];
+        while (block) {
+            Block *next = block->next;
+            for (size_type s = 0; s < block->count; ++s) { // keys are moved, not copied
+                size_type slot;
+                add(h(block->keys()[s]), std::move(block->keys()[s]), slot);
+            }
+            std::destroy_n(block->keys(), block->count);
+            if (block != &old_table[i]) {
+                delete block;
+            }
+            block = next;
+        }
+    }
+    delete[] old_table;
+}
+
+template<typename Key, size_t N>
+void ADS_unrolled_set<Key, N>::prepare_insert() {
+    if (current_size + 1 > table_size * block_keys * 3 / 4) { // blocks of the table 3/4 full on average
+        rehash(table_size * 2);
+    }
+}
+
+template<typename Key, size_t N>
+template<typename ForwardIt, typename Fn>
+void ADS_unrolled_set<Key, N>::lookup_many(ForwardIt first, ForwardIt last, Fn found) const {
+    constexpr size_type distance = 16;
+    size_type boxes[distance];
+    size_type hashed{0};
+    ForwardIt ahead = first;
+    for (size_type done{0}; first != last; ++first, ++done) {
+        for (; hashed < done + distance && ahead != last; ++ahead, ++hashed) {
+            boxes[hashed % distance] = h(*ahead);
+            __builtin_prefetch(&table[boxes[hashed % distance]]);
+        }
+        size_type idx{boxes[done % distance]};
+        size_type slot{0};
+        const Block *block = locate(*first, idx, slot);
+        found(block, idx, slot);
+    }
+}
+
+template<typename Key, size_t N>
+ADS_unrolled_set<Key, N>::ADS_unrolled_set(const ADS_unrolled_set &other) {
+    rehash(other.table_size);
+    for (size_type i = 0; i < other.table_size; ++i) { // same number of boxes, so every key stays in its box
+        for (const Block *block = &other.table[i]; block; block = block->next) {
+            for (size_type s = 0; s < block->count; ++s) {
+                size_type slot;
+                add(i, block->keys()[s], slot);
+            }
+        }
+    }
+}
+
+template<typename Key, size_t N>
+ADS_unrolled_set<Key, N> &ADS_unrolled_set<Key, N>::operator=(const ADS_unrolled_set &other) {
+    if (this != &other) {
+        ADS_unrolled_set copy{other};
+        swap(copy);
+    }
+    return *this;
+}
+
+template<typename Key, size_t N>
+ADS_unrolled_set<Key, N> &ADS_unrolled_set<Key, N>::operator=(std::initializer_list<key_type> ilist) {
+    clear();
+    insert(ilist);
+    return *this;
+}
+
+template<typename Key, size_t N>
+std::pair<typename ADS_unrolled_set<Key, N>::iterator, bool>
+ADS_unrolled_set<Key, N>::insert(const key_type &key) {
+    size_type idx{h(key)};
+    size_type slot;
+    if (Block *block = locate(key, idx, slot)) {
+        return {iterator(table, table_size, idx, block, slot), false};
+    }
+    prepare_insert();
+    idx = h(key);
+    Block *block = add(idx, key, slot);
+    return {iterator(table, table_size, idx, block, slot), true};
+}
+
+template<typename Key, size_t N>
+template<typename InputIt>
+void ADS_unrolled_set<Key, N>::insert(InputIt first, InputIt last) {
+    for (auto it{first}; it != last; ++it) {
+        insert(*it);
+    }
+}
+
+template<typename Key, size_t N>
+void ADS_unrolled_set<Key, N>::clear() {
+    ADS_unrolled_set buffer;
+    swap(buffer);
+}
+
+template<typename Key, size_t N>
+typename ADS_unrolled_set<Key, N>::size_type ADS_unrolled_set<Key, N>::erase(const key_type &key) {
+    size_type idx{h(key)};
+    Block *before{nullptr};
+    for (Block *block = &table[idx]; block; before = block, block = block->next) {
+        mask_t m = match(*block, key);
+        if (!m) {
+            continue;
+        }
+        key_type *keys = block->keys();
+        size_type slot = static_cast<size_type>(__builtin_ctzll(m));
+        size_type last = block->count - size_type{1};
+        if (slot != last) { // compacting, the last key of the block fills the hole
+            keys[slot] = std::move(keys[last]);
+        }
+        keys[last].~key_type();
+        --block->count;
+        --current_size;
+        if (block->count == 0) {
+            if (before) { // empty overflow block is unlinked
+                before->next = block->next;
+                delete block;
+            } else if (Block *next = block->next) { // first block takes over the keys of the next block
+                for (size_type s = 0; s < next->count; ++s) {
+                    ::new(static_cast<void *>(keys + s)) key_type(std::move(next->keys()[s]));
+                }
+                std::destroy_n(next->keys(), next->count);
+                block->count = next->count;
+                block->next = next->next;
+                delete next;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+template<typename Key, size_t N>
+typename ADS_unrolled_set<Key, N>::iterator ADS_unrolled_set<Key, N>::find(const key_type &key) const {
+    size_type idx{h(key)};
+    size_type slot;
+    if (const Block *block = locate(key, idx, slot)) {
+        return iterator(table, table_size, idx, block, slot);
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+void ADS_unrolled_set<Key, N>::swap(ADS_unrolled_set &other) {
+    std::swap(table, other.table);
+    std::swap(table_size, other.table_size);
+    std::swap(current_size, other.current_size);
+}
+
+template<typename Key, size_t N>
+typename ADS_unrolled_set<Key, N>::const_iterator ADS_unrolled_set<Key, N>::begin() const {
+    for (size_type idx = 0; idx < table_size; ++idx) { // only the first block of a chain can be empty
+        if (table[idx].count) {
+            return const_iterator(table, table_size, idx, &table[idx], 0);
+        }
+    }
+    return end();
+}
+
+template<typename Key, size_t N>
+typename ADS_unrolled_set<Key, N>::const_iterator ADS_unrolled_set<Key, N>::end() const {
+    return const_iterator();
+}
+
+template<typename Key, size_t N>
+void ADS_unrolled_set<Key, N>::dump(std::ostream &o) const {
+    o << "Table size = " << table_size << ", Current size = " << current_size << ", Keys per block = "
+      << block_keys << "\n";
+    for (size_type idx = 0; idx < table_size; ++idx) {
+        o << idx << " : ";
+        if (table[idx].count == 0) {
+            o << "--Free\n";
+            continue;
+        }
+        for (const Block *block = &table[idx]; block; block = block->next) {
+            o << "[";
+            for (size_type s = 0; s < block->count; ++s) {
+                o << (s ? " " : "") << block->keys()[s];
+            }
+            o << "]" << (block->next ? " -> " : "");
+        }
+        o << "\n";
+    }
+}
+
+template<typename Key, size_t N>
+class ADS_unrolled_set<Key, N>::Iterator {
+    const Block *table; // the table itself, not the set, so iterators survive swap() and moves of the set
+    size_type table_size;
+    size_type idx;
+    const Block *block;
+    size_type slot;
+
+public:
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using reference = const value_type &;
+    using pointer = const value_type *;
+    using iterator_category = std::forward_iterator_tag;
+
+    explicit Iterator(const Block *table = nullptr, size_type table_size = 0, size_type idx = 0,
+                      const Block *block = nullptr, size_type slot = 0)
+            : table{table}, table_size{table_size}, idx{idx}, block{block}, slot{slot} {}
+
+    reference operator*() const {
+        return block->keys()[slot];
+    }
+
+    pointer operator->() const {
+        return block->keys() + slot;
+    }
+
+    Iterator &operator++() {
+        if (++slot < block->count) { // next key of the block
+            return *this;
+        }
+        slot = 0;
+        if (block->next) { // overflow blocks are never empty
+            block = block->next;
+            return *this;
+        }
+        while (++idx < table_size) {
+            if (table[idx].count) {
+                block = &table[idx];
+                return *this;
+            }
+        }
+        block = nullptr;
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        auto ret_code{*this};
+        ++*this;
+        return ret_code;
+    }
+
+    friend bool operator==(const Iterator &lhs, const Iterator &rhs) {
+        return lhs.block == rhs.block && lhs.slot == rhs.slot;
+    }
+
+    friend bool operator!=(const Iterator &lhs, const Iterator &rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+template<typename Key, size_t N>
+void swap(ADS_unrolled_set<Key, N> &lhs, ADS_unrolled_set<Key, N> &rhs) { lhs.swap(rhs); }
+
+#endif // ADS_UNROLLED_SET_H
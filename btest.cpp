@@ -12,9 +12,12 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <future>
 #include <iostream>
 #include <iterator>
+#include <numeric>
+#include <optional>
 #include <random>
 #include <set>
 #include <sstream>
@@ -61,6 +64,44 @@
 // }}}
 
 #include "ADS_set.h"
+#include "ADS_concurrent_set.h"
+#include "ADS_rcu_set.h"
+#include "ADS_lockfree_set.h"
+
+// storage engine under test, e.g. -DSWISS for the open-addressing ADS_swiss_set
+// -DUNROLLED for ADS_unrolled_set, chaining with cache line sized blocks of keys
+// -DCUCKOO for ADS_cuckoo_set, bucketized cuckoo hashing with two buckets per key
+// -DROBIN for ADS_robin_set, Robin Hood linear probing with backward-shift deletion
+// -DPRIME_GROWTH runs ADS_set with prime table sizes instead of powers of two
+// -DCACHE_HASH runs ADS_set with the full hash stored in every element
+// -DINCREMENTAL runs ADS_set with incremental rehashing, 4 old boxes are moved by every insert and erase
+#if defined SWISS
+#include "ADS_swiss_set.h"
+#define ADS_ENGINE ADS_swiss_set
+#elif defined UNROLLED
+#include "ADS_unrolled_set.h"
+#define ADS_ENGINE ADS_unrolled_set
+#elif defined CUCKOO
+#include "ADS_cuckoo_set.h"
+#define ADS_ENGINE ADS_cuckoo_set
+#elif defined ROBIN
+#include "ADS_robin_set.h"
+#define ADS_ENGINE ADS_robin_set
+#elif defined PRIME_GROWTH
+template <typename Key> struct prime_traits : ADS_set_traits<Key> { using growth_policy = ADS_prime_growth; };
+template <typename Key, size_t n = 7> using ADS_prime_set = ADS_set<Key, n, prime_traits<Key>>;
+#define ADS_ENGINE ADS_prime_set
+#elif defined CACHE_HASH
+template <typename Key> struct cache_hash_traits : ADS_set_traits<Key> { static constexpr bool cache_hash = true; };
+template <typename Key, size_t n = 7> using ADS_cache_hash_set = ADS_set<Key, n, cache_hash_traits<Key>>;
+#define ADS_ENGINE ADS_cache_hash_set
+#elif defined INCREMENTAL
+template <typename Key> struct incremental_traits : ADS_set_traits<Key> { static constexpr size_t incremental_rehash = 4; };
+template <typename Key, size_t n = 7> using ADS_incremental_set = ADS_set<Key, n, incremental_traits<Key>>;
+#define ADS_ENGINE ADS_incremental_set
+#else
+#define ADS_ENGINE ADS_set
+#endif
 
 #if !defined PH1 && !defined PH2
 #define PH2
@@ -166,9 +207,9 @@ namespace ads {
     template <class T>
     using set =
 #ifdef SIZE
-            ADS_set<T, SIZE>;
+            ADS_ENGINE<T, SIZE>;
 #else
-            ADS_set<T>;
+            ADS_ENGINE<T>;
 #endif
 }
 
@@ -1021,6 +1062,49 @@ void test_swap_insert_erase(ads::set<val_t>& a1, std::set<val_t>& r1, ads::set<v
     swap(r1, r2);
 }
 
+void test_swap_move_iter(ads::set<val_t>& a1, std::set<val_t>& r1, ads::set<val_t>& a2, std::set<val_t>& r2) {
+    std::cerr << "\n=== test_swap_move_iter ===\n";
+    using std::swap;
+
+    // iterators point to the keys, not to the set: after swap(a1, a2) an iterator of a1 walks the keys now in a2
+    auto check = [](ads::set<val_t> const& a, std::set<val_t> const& r, ads::set<val_t>::const_iterator it, char const* what) {
+        std::set<val_t> seen;
+        for(; it != a.end(); ++it) {
+            if(!r.count(*it) || !seen.insert(*it).second) {
+                std::cerr << RED("[swap_move_iter] err: iterator taken before " << what << " returned "
+                                         << (r.count(*it) ? "duplicate " : "unexpected ") << "value " << *it << '\n');
+                dump_compare(a, r);
+                std::abort();
+            }
+        }
+        if(seen.size() != r.size()) {
+            std::cerr << RED("[swap_move_iter] err: iterator taken before " << what << " visited " << seen.size()
+                                     << " values, but expected " << r.size() << '\n');
+            dump_compare(a, r);
+            std::abort();
+        }
+    };
+
+    std::cerr << "swap(a1, a2)\n";
+    auto it1 = a1.begin();
+    auto it2 = a2.begin();
+    swap(a1, a2);
+    swap(r1, r2);
+    check(a2, r2, it1, "swap(a1, a2)");
+    check(a1, r1, it2, "swap(a1, a2)");
+
+    std::cerr << "move construction and move assignment\n";
+    it1 = a1.begin();
+    ads::set<val_t> moved{std::move(a1)};
+    check(moved, r1, it1, "move construction");
+    it1 = moved.begin();
+    a1 = std::move(moved);
+    check(a1, r1, it1, "move assignment");
+
+    swap(a1, a2);
+    swap(r1, r2);
+}
+
 void test_equality(ads::set<val_t> const& a1, std::set<val_t> const& r1, ads::set<val_t> const& a2, std::set<val_t> const& r2) {
     std::cerr << "\n=== test_equality ==\n";
     bool eq_a = a1 == a2;
@@ -1237,6 +1321,7 @@ void test_all_ph2(size_t n, size_t max_value, RNG& gen) {
         test_insert(a2, r2, n, max_value, gen);
 
         test_swap_insert_erase(a1, r1, a2, r2, n, max_value, gen);
+        test_swap_move_iter(a1, r1, a2, r2);
 
         test_insert_iter(a1, r1, n, max_value, gen);
         test_insert_iter(a2, r2, n, max_value, gen);
@@ -1394,6 +1479,25 @@ void do_stresstest2(RNG* const gen) {
     }
 
     std::cerr << "elapsed_count  = " << elapsed_count  << " ms\n";
+
+    // same keys in one batch, speedup against the count() loop above
+    double elapsed_count_many;
+    {
+        std::vector<size_t> counts(n);
+        auto start = std::chrono::high_resolution_clock::now();
+        a.count_many(vs.begin(), vs.end(), counts.begin());
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_count_many = std::chrono::duration<double, std::milli>(end - start).count();
+        for(size_t i = 0; i < n; ++i) {
+            if(counts[i] != 1) {
+                std::cerr << RED("[stresstest2] err: count_many missed value " << vs[i] << '\n');
+                std::abort();
+            }
+        }
+    }
+
+    std::cerr << "elapsed_count_many = " << elapsed_count_many << " ms (" << elapsed_count / elapsed_count_many << "x)\n";
     if(gen) { std::shuffle(vs.begin(), vs.end(), *gen); }
 
     double elapsed_find;
@@ -1412,6 +1516,24 @@ void do_stresstest2(RNG* const gen) {
 
     std::cerr << "elapsed_find   = " << elapsed_find  << " ms\n";
 
+    double elapsed_find_many;
+    {
+        std::vector<typename ads::set<val_t>::iterator> its(n);
+        auto start = std::chrono::high_resolution_clock::now();
+        a.find_many(vs.begin(), vs.end(), its.begin());
+        auto end = std::chrono::high_resolution_clock::now();
+
+        elapsed_find_many = std::chrono::duration<double, std::milli>(end - start).count();
+        for(size_t i = 0; i < n; ++i) {
+            if(its[i] == a.end() || !std::equal_to<val_t>{}(*its[i], vs[i])) {
+                std::cerr << RED("[stresstest2] err: find_many returned wrong iterator for value " << vs[i] << '\n');
+                std::abort();
+            }
+        }
+    }
+
+    std::cerr << "elapsed_find_many  = " << elapsed_find_many << " ms (" << elapsed_find / elapsed_find_many << "x)\n";
+
     if(!gen) {
         double elapsed_iter;
         size_t i = 0;
@@ -1459,6 +1581,201 @@ void do_stresstest2(RNG* const gen) {
     }
 
     std::cerr << "elapsed_erase  = " << elapsed_erase  << " ms\n";
+
+    // slowest inserts, a rehash of the whole table shows up here
+    std::vector<double> latencies;
+    latencies.reserve(n);
+    {
+        ads::set<val_t> b;
+        for(auto const& v: vs) {
+            auto start = std::chrono::high_resolution_clock::now();
+            b.insert(v);
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cerr << "insert_p99.9  = " << latencies[n - n / 1000] << " us, insert_max = " << latencies.back() << " us\n";
+}
+
+// insertion status of the concurrent sets, bool or ADS_set style pair
+bool inserted(bool b) { return b; }
+template <class It>
+bool inserted(std::pair<It, bool> const& p) { return p.second; }
+
+// insert/count throughput of a concurrent set (ADS_concurrent_set with the engine under test in every stripe,
+// ADS_rcu_set or ADS_lockfree_set), from 1 to N threads
+template <class C>
+void do_concurrent_stresstest(RNG* const gen, char const* name) {
+    std::cerr << "\n=== concurrent stresstest " << name << ' ' << (gen ? "(randomized) " : "") << "===\n";
+
+    size_t const n = 1'000'000;
+    std::vector<val_t> vs(n);
+    std::iota(vs.begin(), vs.end(), 0);
+
+    if(gen) { std::shuffle(vs.begin(), vs.end(), *gen); }
+
+    // every thread works on its own slice of vs, returns elapsed ms
+    auto run = [&vs, n](unsigned threads, auto op) {
+        std::vector<std::thread> workers;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&vs, &op, t, threads, n] {
+                for(size_t i = n * t / threads; i < n * (t + 1) / threads; ++i) { op(vs[i]); }
+            });
+        }
+        for(auto& w: workers) { w.join(); }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    unsigned const max_threads = std::max(4u, std::thread::hardware_concurrency());
+    double base_insert = 0, base_count = 0;
+    for(unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        C a;
+        std::atomic<size_t> errors{0};
+
+        double elapsed_insert = run(threads, [&a, &errors](val_t const& v) { if(!inserted(a.insert(v))) { ++errors; } });
+        double elapsed_count = run(threads, [&a, &errors](val_t const& v) { if(a.count(v) != 1) { ++errors; } });
+
+        if(errors || a.size() != n) {
+            std::cerr << RED("[concurrent stresstest] " << name << " err: " << errors << " wrong results, size " << a.size() << " instead of " << n << '\n');
+            std::abort();
+        }
+        if(threads == 1) {
+            base_insert = elapsed_insert;
+            base_count = elapsed_count;
+        }
+        std::cerr << "threads = " << threads
+                  << ": elapsed_insert = " << elapsed_insert << " ms (" << base_insert / elapsed_insert << "x)"
+                  << ", elapsed_count = " << elapsed_count << " ms (" << base_count / elapsed_count << "x)\n";
+    }
+}
+
+// find() of the concurrent sets, std::optional or an iterator into the set
+template <class C>
+bool found(C const& a, val_t const& v) {
+    auto r = a.find(v);
+    if constexpr(std::is_same<decltype(r), std::optional<val_t>>::value) {
+        return r && std::equal_to<val_t>{}(*r, v);
+    } else {
+        return r != a.end() && std::equal_to<val_t>{}(*r, v);
+    }
+}
+
+// number of keys a walk over the set visits, ADS_lockfree_set has iterators instead of for_each()
+template <class C>
+size_t visited_keys(C const& a) {
+    size_t n = 0;
+    if constexpr(std::is_same<C, ADS_lockfree_set<val_t>>::value) {
+        for(auto it = a.begin(); it != a.end(); ++it) { ++n; }
+    } else {
+        a.for_each([&n](val_t const&) { ++n; });
+    }
+    return n;
+}
+
+// mixed insert/erase/find/count on several threads at the same time, checked against a sequential model:
+// every thread owns the keys t, t + threads, t + 2 * threads, ... (so they share stripes, buckets and list
+// segments with the keys of the other threads) and checks every result against its own model of them. Besides,
+// all threads insert and later erase the same shared keys, exactly one insert and one erase of each key has to
+// succeed. Afterwards the set has to hold exactly the keys of the models
+template <class C>
+void test_concurrent_mixed(RNG& gen, char const* name) {
+    std::cerr << "test_concurrent_mixed " << name << '\n';
+
+    unsigned const threads = std::max(4u, std::thread::hardware_concurrency());
+    size_t const own = 4096;     // keys per thread
+    size_t const shared = 8192;  // keys all threads insert and erase, after the own keys
+    size_t const ops = 40'000;   // own operations per thread and phase
+
+    C a;
+    std::vector<std::vector<char>> models(threads, std::vector<char>(own));
+    std::vector<RNG> gens;
+    for(unsigned t = 0; t < threads; ++t) { gens.emplace_back(gen()); }
+    std::atomic<size_t> errors{0};
+    std::atomic<size_t> shared_done{0};
+
+    // phase 0 inserts the shared keys between the own operations, phase 1 erases them
+    auto run = [&](unsigned phase) {
+        std::vector<std::thread> workers;
+        for(unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                RNG& rng = gens[t];
+                std::vector<char>& model = models[t];
+                std::vector<size_t> order(shared);
+                std::iota(order.begin(), order.end(), own * threads);
+                std::shuffle(order.begin(), order.end(), rng);
+                size_t next_shared = 0;
+                size_t wrong = 0, done = 0;
+                for(size_t op = 0; op < ops; ++op) {
+                    size_t j = rng() % own;
+                    val_t v{ t + threads * j };
+                    switch(rng() % 4) {
+                        case 0:
+                            if(inserted(a.insert(v)) != !model[j]) { ++wrong; }
+                            model[j] = 1;
+                            break;
+                        case 1:
+                            if(a.erase(v) != static_cast<size_t>(model[j])) { ++wrong; }
+                            model[j] = 0;
+                            break;
+                        case 2:
+                            if(found(a, v) != static_cast<bool>(model[j])) { ++wrong; }
+                            break;
+                        default:
+                            if(a.count(v) != static_cast<size_t>(model[j])) { ++wrong; }
+                    }
+                    if(op % 4 == 0 && next_shared < shared) {
+                        val_t sv{ order[next_shared++] };
+                        done += phase == 0 ? inserted(a.insert(sv)) : a.erase(sv);
+                    }
+                }
+                for(; next_shared < shared; ++next_shared) {
+                    val_t sv{ order[next_shared] };
+                    done += phase == 0 ? inserted(a.insert(sv)) : a.erase(sv);
+                }
+                errors += wrong;
+                shared_done += done;
+            });
+        }
+        for(auto& w: workers) { w.join(); }
+    };
+
+    for(unsigned phase = 0; phase < 2; ++phase) {
+        shared_done = 0;
+        run(phase);
+        if(errors || shared_done != shared) {
+            std::cerr << RED("[test_concurrent_mixed] " << name << " err: " << errors << " wrong results, "
+                             << shared_done << " of " << shared << " shared keys " << (phase == 0 ? "inserted" : "erased")
+                             << " instead of " << shared << '\n');
+            std::abort();
+        }
+    }
+
+    size_t expected = 0;
+    for(unsigned t = 0; t < threads; ++t) {
+        for(size_t j = 0; j < own; ++j) {
+            val_t v{ t + threads * j };
+            if(a.count(v) != static_cast<size_t>(models[t][j])) {
+                std::cerr << RED("[test_concurrent_mixed] " << name << " err: count(" << v << ") != " << static_cast<int>(models[t][j]) << " after all threads are done\n");
+                std::abort();
+            }
+            expected += models[t][j];
+        }
+    }
+    for(size_t k = own * threads; k < own * threads + shared; ++k) {
+        if(a.count(val_t{ k })) {
+            std::cerr << RED("[test_concurrent_mixed] " << name << " err: shared key " << k << " still there\n");
+            std::abort();
+        }
+    }
+    size_t visited = visited_keys(a);
+    if(a.size() != expected || visited != expected) {
+        std::cerr << RED("[test_concurrent_mixed] " << name << " err: size " << a.size() << ", for_each visits " << visited << ", should be " << expected << '\n');
+        std::abort();
+    }
 }
 #endif
 
@@ -1609,6 +1926,11 @@ int main(int argc, char** argv) {
     if(only_benchmark) {
         stresstest();
         stresstest(&gen);
+#ifdef PH2
+        do_concurrent_stresstest<ADS_concurrent_set<val_t, ads::set<val_t>>>(&gen, "ADS_concurrent_set");
+        do_concurrent_stresstest<ADS_rcu_set<val_t>>(&gen, "ADS_rcu_set");
+        do_concurrent_stresstest<ADS_lockfree_set<val_t>>(&gen, "ADS_lockfree_set");
+#endif
 
         return 0;
     }
@@ -1637,6 +1959,12 @@ int main(int argc, char** argv) {
         gen.seed(s);
     }
 
+#ifdef PH2
+    test_concurrent_mixed<ADS_concurrent_set<val_t, ads::set<val_t>>>(gen, "ADS_concurrent_set");
+    test_concurrent_mixed<ADS_rcu_set<val_t>>(gen, "ADS_rcu_set");
+    test_concurrent_mixed<ADS_lockfree_set<val_t>>(gen, "ADS_lockfree_set");
+#endif
+
     if(no_benchmark) { return 0; }
 //    if(RUNNING_ON_VALGRIND) {
 //        std::cerr << CYAN("NOTE: ") << "stresstest disabled because program is running under valgrind.\n";
@@ -52,8 +52,55 @@ static constexpr char version[] {"20220614"};
 #include <algorithm>
 #include <random>
 #include <numeric>
+#include <functional>
+#include <mutex>
 #include "ADS_set.h"
 
+// storage engine under test, e.g. -DSWISS for the open-addressing ADS_swiss_set
+// -DUNROLLED for ADS_unrolled_set, chaining with cache line sized blocks of keys
+// -DCUCKOO for ADS_cuckoo_set, bucketized cuckoo hashing with two buckets per key
+// -DROBIN for ADS_robin_set, Robin Hood linear probing with backward-shift deletion
+// -DPRIME_GROWTH runs ADS_set with prime table sizes instead of powers of two
+// -DCACHE_HASH runs ADS_set with the full hash stored in every element
+// -DINCREMENTAL runs ADS_set with incremental rehashing, 4 old boxes are moved by every insert and erase
+#if defined SWISS
+#include "ADS_swiss_set.h"
+#define ADS_ENGINE ADS_swiss_set
+#elif defined UNROLLED
+#include "ADS_unrolled_set.h"
+#define ADS_ENGINE ADS_unrolled_set
+#elif defined CUCKOO
+#include "ADS_cuckoo_set.h"
+#define ADS_ENGINE ADS_cuckoo_set
+#elif defined ROBIN
+#include "ADS_robin_set.h"
+#define ADS_ENGINE ADS_robin_set
+#elif defined PRIME_GROWTH
+template <typename Key> struct prime_traits : ADS_set_traits<Key> { using growth_policy = ADS_prime_growth; };
+template <typename Key, size_t n = 7> using ADS_prime_set = ADS_set<Key, n, prime_traits<Key>>;
+#define ADS_ENGINE ADS_prime_set
+#define ADS_TRAITS prime_traits
+#elif defined CACHE_HASH
+template <typename Key> struct cache_hash_traits : ADS_set_traits<Key> { static constexpr bool cache_hash = true; };
+template <typename Key, size_t n = 7> using ADS_cache_hash_set = ADS_set<Key, n, cache_hash_traits<Key>>;
+#define ADS_ENGINE ADS_cache_hash_set
+#define ADS_TRAITS cache_hash_traits
+#elif defined INCREMENTAL
+template <typename Key> struct incremental_traits : ADS_set_traits<Key> { static constexpr size_t incremental_rehash = 4; };
+template <typename Key, size_t n = 7> using ADS_incremental_set = ADS_set<Key, n, incremental_traits<Key>>;
+#define ADS_ENGINE ADS_incremental_set
+#define ADS_TRAITS incremental_traits
+#else
+#define ADS_ENGINE ADS_set
+#define ADS_TRAITS ADS_set_traits
+#endif
+
+// ADS_set and its variants have more methods than the other engines (set algebra, load factors, parallel insert ...),
+// the commands testing them only exist for these
+#if !defined SWISS && !defined UNROLLED && !defined CUCKOO && !defined ROBIN
+#define ADS_SET_EXTENSIONS
+#endif
+
 #ifndef ETYPE
 #error ETYPE not defined - compile with option -DETYPE=type
 #else
@@ -68,12 +115,12 @@ static constexpr char version[] {"20220614"};
  using reference_set = std::set<Key>;
 
  #ifdef SIZE
-   using ads_set = ADS_set<Key,SIZE>;
+   using ads_set = ADS_ENGINE<Key,SIZE>;
  #else
-   using ads_set = ADS_set<Key>;
+   using ads_set = ADS_ENGINE<Key>;
  #endif
 
- enum class Code {quit = 0, new_set, delete_set, insert, erase, find, count, size, empty, dump, trace, finsert, ferase, rinsert, rerase, help, clear, iterator, list, iinsert, fiinsert, riinsert};
+ enum class Code {quit = 0, new_set, delete_set, insert, erase, find, count, size, empty, dump, trace, finsert, ferase, rinsert, rerase, help, clear, iterator, list, iinsert, fiinsert, riinsert, algebra, digest, load, reserve, rehash, shrink, move, emplace, remplace, transparent, pinsert, foreach, memory};
 
  struct Command {
    Code code;
@@ -101,6 +148,21 @@ static constexpr char version[] {"20220614"};
    {Code::ferase, "ferase <filename>", "erase values from file <filename>", true, false, true},
    {Code::clear, "clear", "call clear()", true, false, true},
    {Code::iterator, "iterator", "iterator/find test", true, false},
+ #endif
+ #if defined PH2 && defined ADS_SET_EXTENSIONS
+   {Code::algebra, "algebra [<n> [<seed>]]", "set algebra with a set of every second key and <n> random values, optionally reset generator to <seed>", true, false},
+   {Code::digest, "digest", "operator==/!= and digest() of a copy after erase and insert of every key", true, false},
+   {Code::load, "load [<max> [<min>]]", "call load_factor(), bucket_count(), optionally set max_load_factor(<max>) and min_load_factor(<min>)", true, false, true},
+   {Code::reserve, "reserve <n>", "call reserve(<n>) and insert random values up to size <n>, the table must not grow", true, false, true},
+   {Code::rehash, "rehash <n>", "call rehash(<n>)", true, false, true},
+   {Code::shrink, "shrink", "call shrink_to_fit()", true, false, true},
+   {Code::move, "move", "move construct and move assign the set away and back", true, false, true},
+   {Code::emplace, "emplace <keys>", "emplace <keys>, alternately moved and built from a reference", true, true, true},
+   {Code::remplace, "remplace [<n> [<seed>]]", "emplace <n> random values, optionally reset generator to <seed>", true, false, true},
+   {Code::transparent, "transparent [<n> [<seed>]]", "find/count/erase with another key type in a copy with transparent hasher, <n> random values, optionally reset generator to <seed>", true, false},
+   {Code::pinsert, "pinsert [<n> [<seed> [<threads>]]]", "insert <n> random values with duplicates and every third key, call insert_parallel() on <threads> threads (0: one per core), optionally reset generator to <seed>", true, false, true},
+   {Code::foreach, "foreach [<grain>]", "for_each() without and with execution policies, box_range(<grain>) split as far as it goes", true, false},
+   {Code::memory, "memory [<n> [<keep> [<seed>]]]", "insert <n> random values into a set with a counting allocator and min_load_factor 0.2, erase all but <keep>, call shrink_to_fit(), the erases must not allocate more", true, false},
  #endif
    {Code::dump, "dump", "call dump()", true, false},
    {Code::trace, "trace", "toggle tracing on/off", false, false},
@@ -231,6 +293,59 @@ static constexpr char version[] {"20220614"};
    };
  }
 
+ #if defined PH2 && defined ADS_SET_EXTENSIONS
+ // another type for keys, lookups with it need a transparent hasher and key_equal (see ADS_set_traits::hasher)
+ struct Key_ref {
+   const Key *key;
+ };
+ struct transparent_hash {
+   using is_transparent = void;
+   size_t operator()(const Key &k) const { return std::hash<Key>{}(k); }
+   size_t operator()(const Key_ref &k) const { return std::hash<Key>{}(*k.key); }
+ };
+ struct transparent_equal {
+   using is_transparent = void;
+   static const Key &get(const Key &k) { return k; }
+   static const Key &get(const Key_ref &k) { return *k.key; }
+   template <typename L, typename R>
+   bool operator()(const L &lhs, const R &rhs) const { return std::equal_to<Key>{}(get(lhs), get(rhs)); }
+ };
+ template <typename K> struct transparent_traits : ADS_TRAITS<K> {
+   using hasher = transparent_hash;
+   using key_equal = transparent_equal;
+ };
+ #ifdef SIZE
+   using transparent_set = ADS_set<Key,SIZE,transparent_traits<Key>>;
+ #else
+   using transparent_set = ADS_set<Key,7,transparent_traits<Key>>;
+ #endif
+ // allocator which counts the bytes all its copies hold
+ size_t allocated_bytes {0};
+ template <typename T> struct counting_allocator {
+   using value_type = T;
+   counting_allocator() = default;
+   template <typename U> counting_allocator(const counting_allocator<U> &) {}
+   T *allocate(size_t n) {
+     T *p {std::allocator<T>{}.allocate(n)};
+     allocated_bytes += n * sizeof(T);
+     return p;
+   }
+   void deallocate(T *p, size_t n) {
+     allocated_bytes -= n * sizeof(T);
+     std::allocator<T>{}.deallocate(p, n);
+   }
+ };
+ template <typename T, typename U>
+ bool operator==(const counting_allocator<T> &, const counting_allocator<U> &) { return true; }
+ template <typename T, typename U>
+ bool operator!=(const counting_allocator<T> &, const counting_allocator<U> &) { return false; }
+ #ifdef SIZE
+   using counting_set = ADS_set<Key,SIZE,ADS_TRAITS<Key>,counting_allocator<Key>>;
+ #else
+   using counting_set = ADS_set<Key,7,ADS_TRAITS<Key>,counting_allocator<Key>>;
+ #endif
+ #endif
+
  struct Rand {
    std::default_random_engine re;
    std::uniform_int_distribution<uint32_t> dist;
@@ -262,6 +377,19 @@ static constexpr char version[] {"20220614"};
    return buf.str();
  }
  #ifdef PH2
+ #ifdef ADS_SET_EXTENSIONS
+ // an erase which leaves the load below min_load_factor() shrinks the table to the load halfway between both load
+ // factors, but not below the initial table size. The table sizes round this up (primes by up to 2.3 times)
+ void test_shrunk(const ads_set &c) {
+   static const size_t smallest {ads_set{}.bucket_count()};
+   double halfway {(static_cast<double>(c.min_load_factor()) + c.max_load_factor()) / 2};
+   size_t needed {std::max(smallest, static_cast<size_t>(std::ceil(c.size() / halfway)))};
+   size_t shrink_at {static_cast<size_t>(static_cast<double>(c.bucket_count()) * c.min_load_factor())}; // rounded down
+   if (c.size() < shrink_at && c.bucket_count() > 3 * needed)
+     std::cout << "\n ERROR - load " << c.load_factor() << " below min_load_factor " << c.min_load_factor()
+       << " after erase, bucket_count " << c.bucket_count() << '\n';
+ }
+ #endif
  void test_insert(const Key &k, ads_set *c, reference_set *r, bool verbose = false) {
    auto r_rc {r->insert(k)};
    auto c_rc {c->insert(k)};
@@ -278,7 +406,22 @@ static constexpr char version[] {"20220614"};
      std::cout << "\n ERROR for " << k << ", returns " << c_rc << ", should be " << r_rc << '\n';
    else if (verbose)
      std::cout << ' ' << c_rc;
+ #ifdef ADS_SET_EXTENSIONS
+   if (c_rc) test_shrunk(*c);
+ #endif
  }
+ #ifdef ADS_SET_EXTENSIONS
+ // emplace() with an rvalue key (passed on to insert()) or with a reference wrapper, the key is built from it then
+ void test_emplace(const Key &k, bool build, ads_set *c, reference_set *r, bool verbose = false) {
+   auto r_rc {r->emplace(k)};
+   auto c_rc {build ? c->emplace(std::cref(k)) : c->emplace(Key{k})};
+   if (!it_equal(*r, r_rc.first, *c, c_rc.first) || r_rc.second != c_rc.second)
+     std::cout << "\n ERROR for " << k << ", returns {" << it2str(*c, c_rc.first) << ", " << c_rc.second
+       << "}, should be {" << it2str(*r, r_rc.first) << ", " << r_rc.second << "}\n";
+   else if (verbose)
+     std::cout << " {" << it2str(*r, r_rc.first) << ", " << c_rc.second << "}";
+ }
+ #endif
  void test_find(const Key &k, const ads_set *c, const reference_set *r, bool verbose = false) {
    auto c_rc {c->find(k)};
    auto r_rc {r->find(k)};
@@ -296,6 +439,134 @@ static constexpr char version[] {"20220614"};
    else if (verbose)
      std::cout << ' ' << c_rc;
  }
+ #if defined PH2 && defined ADS_SET_EXTENSIONS
+ // compares the keys of c (size, count() and iteration) with the reference
+ template <typename C>
+ bool test_contents(const C &c, const reference_set &r, const std::string &what) {
+   if (c.size() != r.size()) {
+     std::cout << "\n ERROR - " << what << ": size " << c.size() << ", should be " << r.size() << '\n';
+     return false;
+   }
+   for (const Key &k: r) {
+     if (!c.count(k)) {
+       std::cout << "\n ERROR - " << what << ": " << k << " missing\n";
+       return false;
+     }
+   }
+   size_t n {0};
+   for (const Key &k: c) {
+     if (!r.count(k)) {
+       std::cout << "\n ERROR - " << what << ": " << k << " should not be there\n";
+       return false;
+     }
+     ++n;
+   }
+   if (n != r.size()) {
+     std::cout << "\n ERROR - " << what << ": iterator visits " << n << " keys, should be " << r.size() << '\n';
+     return false;
+   }
+   return true;
+ }
+ // runs op (the member function) and free_op (the free function) without and with execution policies, a op b
+ // should give expected and b op a reverse_expected
+ template <typename Op, typename FreeOp>
+ void test_set_op(const std::string &name, Op op, FreeOp free_op, const ads_set &a, const ads_set &b,
+                  const reference_set &expected, const reference_set &reverse_expected) {
+   for (bool reverse: {false, true}) {
+     const ads_set &lhs {reverse ? b : a};
+     const ads_set &rhs {reverse ? a : b};
+     const reference_set &r {reverse ? reverse_expected : expected};
+     ads_set x {lhs};
+     op(x, rhs);
+     test_contents(x, r, name);
+     x = lhs;
+     op(x, rhs, std::execution::seq);
+     test_contents(x, r, name + "(seq)");
+     x = lhs;
+     op(x, rhs, std::execution::par);
+     test_contents(x, r, name + "(par)");
+     test_contents(free_op(lhs, rhs), r, "free " + name);
+     test_contents(free_op(lhs, rhs, std::execution::par_unseq), r, "free " + name + "(par_unseq)");
+   }
+ }
+ // merge_union(), intersect(), subtract() and symmetric_difference() of a and b
+ void test_algebra(const ads_set &a, const reference_set &ra, const ads_set &b, const reference_set &rb) {
+   auto less {ra.key_comp()};
+   reference_set u, i, d, reverse_d, sd;
+   std::set_union(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(u, u.end()), less);
+   std::set_intersection(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(i, i.end()), less);
+   std::set_difference(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(d, d.end()), less);
+   std::set_difference(rb.begin(), rb.end(), ra.begin(), ra.end(), std::inserter(reverse_d, reverse_d.end()), less);
+   std::set_symmetric_difference(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(sd, sd.end()), less);
+   test_set_op("merge_union",
+               [](ads_set &x, const ads_set &y, auto... policy) { x.merge_union(policy..., y); },
+               [](const ads_set &x, const ads_set &y, auto... policy) { return merge_union(policy..., x, y); },
+               a, b, u, u);
+   test_set_op("intersect",
+               [](ads_set &x, const ads_set &y, auto... policy) { x.intersect(policy..., y); },
+               [](const ads_set &x, const ads_set &y, auto... policy) { return intersect(policy..., x, y); },
+               a, b, i, i);
+   test_set_op("subtract",
+               [](ads_set &x, const ads_set &y, auto... policy) { x.subtract(policy..., y); },
+               [](const ads_set &x, const ads_set &y, auto... policy) { return subtract(policy..., x, y); },
+               a, b, d, reverse_d);
+   test_set_op("symmetric_difference",
+               [](ads_set &x, const ads_set &y, auto... policy) { x.symmetric_difference(policy..., y); },
+               [](const ads_set &x, const ads_set &y, auto... policy) { return symmetric_difference(policy..., x, y); },
+               a, b, sd, sd);
+ }
+ // find(), count() and erase() of t with Key_ref, r has the same keys
+ void test_transparent(const Key &k, transparent_set *t, reference_set *r, bool erase) {
+   Key_ref ref {&k};
+   auto t_it {t->find(ref)};
+   auto r_it {r->find(k)};
+   if (!it_equal(*t, t_it, *r, r_it) || t->count(ref) != r->count(k))
+     std::cout << "\n ERROR for " << k << ", find returns " << it2str(*t, t_it) << ", count " << t->count(ref)
+       << ", should be " << it2str(*r, r_it) << " and " << r->count(k) << '\n';
+   if (erase) {
+     size_t r_rc {r->erase(k)};
+     size_t t_rc {t->erase(ref)};
+     if (r_rc != t_rc)
+       std::cout << "\n ERROR for " << k << ", erase returns " << t_rc << ", should be " << r_rc << '\n';
+   }
+ }
+ // keys visits every key of r exactly once
+ void test_visited(const std::vector<Key> &keys, const reference_set &r, const std::string &what) {
+   reference_set visited {keys.begin(), keys.end()};
+   if (keys.size() != r.size() || visited.size() != r.size() ||
+       !std::equal(visited.begin(), visited.end(), r.begin(), std::equal_to<Key>{}))
+     std::cout << "\n ERROR - " << what << " visits " << keys.size() << " keys (" << visited.size()
+       << " different), should be " << r.size() << '\n';
+ }
+ // a and b have the same keys if equal, == and != and the digests have to agree on that
+ void test_equal(const ads_set &a, const ads_set &b, bool equal, const std::string &what) {
+   if ((a == b) != equal || (a != b) == equal || (b == a) != equal || (b != a) == equal)
+     std::cout << "\n ERROR - " << what << ": operator== returns " << (a == b) << ", operator!= " << (a != b)
+       << ", should be " << equal << " and " << !equal << '\n';
+   else if (equal && a.digest() != b.digest())
+     std::cout << "\n ERROR - " << what << ": different digests for the same keys\n";
+ }
+ // the keys need at most max_load_factor() keys per box, the table grows once that is reached (rounded up)
+ void test_load(const ads_set &c) {
+   if (c.load_factor() > c.max_load_factor() + 1.0f / static_cast<float>(c.bucket_count()))
+     std::cout << "\n ERROR - load " << c.load_factor() << " above max_load_factor " << c.max_load_factor()
+       << ", bucket_count " << c.bucket_count() << '\n';
+ }
+ // load factors which let a grown table shrink again are rejected and leave both factors as they were
+ void test_load_factors(ads_set *c) {
+   float max_load {c->max_load_factor()}, min_load {c->min_load_factor()};
+   bool max_thrown {false}, min_thrown {false};
+   try { c->min_load_factor(max_load / 2); } catch (const std::invalid_argument &) { min_thrown = true; }
+   if (min_load > 0.0f)
+     try { c->max_load_factor(min_load * 2); } catch (const std::invalid_argument &) { max_thrown = true; }
+   else max_thrown = true;
+   if (!min_thrown || !max_thrown)
+     std::cout << "\n ERROR - load factors " << c->max_load_factor() << " and " << c->min_load_factor() << " accepted\n";
+   else if (c->max_load_factor() != max_load || c->min_load_factor() != min_load)
+     std::cout << "\n ERROR - load factors " << c->max_load_factor() << " and " << c->min_load_factor()
+       << " after they were rejected, should be " << max_load << " and " << min_load << '\n';
+ }
+ #endif
 
  int main() {
    Rand random;
@@ -470,6 +741,235 @@ static constexpr char version[] {"20220614"};
            break;
          }
  #endif // PH2
+ #if defined PH2 && defined ADS_SET_EXTENSIONS
+         case Code::algebra: {
+           unsigned seed, count{1};
+           line_stream >> count;
+           if (line_stream >> seed) random.seed(seed);
+           reference_set other_r;
+           bool take {true};
+           for (const Key &k: *r) {
+             if (take) other_r.insert(k);
+             take = !take;
+           }
+           while (count-- > 0) other_r.insert(random.next<Key>());
+           ads_set other;
+           other.insert(other_r.begin(), other_r.end());
+           test_algebra(*const_c, *r, other, other_r);
+           break;
+         }
+         case Code::digest: {
+           ads_set copy {*const_c};
+           test_equal(*const_c, copy, true, "copy");
+           for (const Key &k: *r) {
+             copy.erase(k);
+             test_equal(*const_c, copy, false, "after erase");
+             copy.insert(k);
+             test_equal(*const_c, copy, true, "after erase and insert");
+           }
+           Key other {random.next<Key>()};
+           if (!r->count(other)) {
+             copy.insert(other);
+             test_equal(*const_c, copy, false, "after insert");
+             copy.erase(other);
+             test_equal(*const_c, copy, true, "after insert and erase");
+           }
+           ads_set reversed;
+           for (auto it {r->rbegin()}; it != r->rend(); ++it) reversed.insert(*it);
+           test_equal(*const_c, reversed, true, "keys inserted in reverse order");
+           break;
+         }
+         case Code::load: {
+           float max_load, min_load;
+           if (line_stream >> max_load) c->max_load_factor(max_load);
+           if (line_stream >> min_load) c->min_load_factor(min_load);
+           std::cout << ' ' << const_c->load_factor() << ' ' << const_c->bucket_count();
+           test_load(*const_c);
+           test_load_factors(c);
+           test_contents(*const_c, *r, "load");
+           break;
+         }
+         case Code::reserve: {
+           size_t count {0};
+           line_stream >> count;
+           c->reserve(count);
+           size_t buckets {const_c->bucket_count()};
+           if (buckets * static_cast<double>(const_c->max_load_factor()) < static_cast<double>(count))
+             std::cout << " ERROR - bucket_count " << buckets << " too small for " << count << " keys";
+           for (size_t tries {0}; const_c->size() < count && tries < 4 * count; ++tries)
+             test_insert(random.next<Key>(), c, r);
+           if (const_c->bucket_count() != buckets)
+             std::cout << " ERROR - bucket_count " << const_c->bucket_count() << " after inserts, should be " << buckets;
+           test_contents(*const_c, *r, "reserve");
+           break;
+         }
+         case Code::rehash: {
+           size_t count {0};
+           line_stream >> count;
+           c->rehash(count);
+           if (const_c->bucket_count() < count)
+             std::cout << " ERROR - bucket_count " << const_c->bucket_count() << ", should be at least " << count;
+           test_load(*const_c);
+           test_contents(*const_c, *r, "rehash");
+           break;
+         }
+         case Code::shrink: {
+           size_t before {const_c->bucket_count()};
+           c->shrink_to_fit();
+           if (const_c->bucket_count() > before)
+             std::cout << " ERROR - bucket_count " << const_c->bucket_count() << ", was " << before;
+           test_load(*const_c);
+           test_contents(*const_c, *r, "shrink_to_fit");
+           break;
+         }
+         case Code::move: {
+           ads_set moved {std::move(*c)};
+           test_contents(moved, *r, "move constructed");
+           test_contents(*const_c, reference_set{}, "moved from");
+           for (const Key &k: *r) c->insert(k); // the moved from set can be used again
+           test_contents(*const_c, *r, "moved from, refilled");
+           c->clear();
+           *c = std::move(moved);
+           test_contents(*const_c, *r, "move assigned");
+           test_contents(moved, reference_set{}, "moved from");
+           ads_set other;
+           for (unsigned i {0}; i < 10; ++i) other.insert(random.next<Key>());
+           other = std::move(*c); // the keys of other are dropped
+           test_contents(other, *r, "move assigned to a set with keys");
+           *c = std::move(other);
+           test_contents(*const_c, *r, "move assigned back");
+           break;
+         }
+         case Code::emplace: {
+           bool build {false};
+           for (const Key &k: key_v) test_emplace(k, build = !build, c, r, true);
+           break;
+         }
+         case Code::remplace: {
+           unsigned seed, count{1};
+           line_stream >> count;
+           if (line_stream >> seed) random.seed(seed);
+           bool build {false};
+           while (count-- > 0) test_emplace(random.next<Key>(), build = !build, c, r);
+           break;
+         }
+         case Code::transparent: {
+           unsigned seed, count{1};
+           line_stream >> count;
+           if (line_stream >> seed) random.seed(seed);
+           transparent_set t;
+           t.insert(const_c->begin(), const_c->end());
+           reference_set t_r {*r};
+           std::vector<Key> keys {r->begin(), r->end()};
+           while (count-- > 0) keys.push_back(random.next<Key>());
+           bool erase {false};
+           for (const Key &k: keys) test_transparent(k, &t, &t_r, erase = !erase);
+           for (const Key &k: keys) test_transparent(k, &t, &t_r, false);
+           test_contents(t, t_r, "transparent erase");
+           break;
+         }
+         case Code::pinsert: {
+           unsigned seed, count{1}, threads{0};
+           line_stream >> count;
+           if (line_stream >> seed) random.seed(seed);
+           line_stream >> threads;
+           std::vector<Key> v;
+           for (unsigned i {0}; i < count; ++i) v.push_back(random.next<Key>());
+           for (unsigned i {0}; i < count / 4; ++i) v.push_back(v[i]); // duplicates in the range
+           size_t i {0};
+           for (const Key &k: *r) if (i++ % 3 == 0) v.push_back(k); // keys the set has already
+           std::shuffle(v.begin(), v.end(), random.re);
+           r->insert(v.begin(), v.end());
+           auto half {v.begin() + static_cast<std::ptrdiff_t>(v.size() / 2)};
+           c->insert_parallel(v.begin(), half, threads);
+           c->insert_parallel(std::make_move_iterator(half), std::make_move_iterator(v.end()), threads);
+           test_contents(*const_c, *r, "insert_parallel");
+           break;
+         }
+         case Code::foreach: {
+           size_t grain {1024};
+           line_stream >> grain;
+           std::vector<Key> keys;
+           std::mutex keys_mutex;
+           const_c->for_each([&keys](const Key &k) { keys.push_back(k); });
+           test_visited(keys, *r, "for_each");
+           keys.clear();
+           const_c->for_each(std::execution::seq, [&keys](const Key &k) { keys.push_back(k); });
+           test_visited(keys, *r, "for_each(seq)");
+           keys.clear();
+           const_c->for_each(std::execution::par, [&keys, &keys_mutex](const Key &k) {
+             std::lock_guard<std::mutex> lock {keys_mutex};
+             keys.push_back(k);
+           });
+           test_visited(keys, *r, "for_each(par)");
+           // split like a work-stealing scheduler would, alternately with split() and the splitting constructor
+           auto whole {const_c->box_range(grain)};
+           std::vector<decltype(whole)> todo {whole}, done;
+           bool by_constructor {false};
+           while (!todo.empty()) {
+             auto range {todo.back()};
+             todo.pop_back();
+             if (!range.is_divisible()) {
+               done.push_back(range);
+               continue;
+             }
+             auto upper {(by_constructor = !by_constructor) ? decltype(range){range, 0} : range.split()};
+             if (range.empty() || upper.empty() || range.end_box() != upper.begin_box())
+               std::cout << " ERROR - split [" << range.begin_box() << ", " << range.end_box() << ") and ["
+                 << upper.begin_box() << ", " << upper.end_box() << ")";
+             todo.push_back(range);
+             todo.push_back(upper);
+           }
+           std::sort(done.begin(), done.end(), [](const auto &a, const auto &b) { return a.begin_box() < b.begin_box(); });
+           size_t next {whole.begin_box()};
+           keys.clear();
+           for (const auto &range: done) {
+             if (range.begin_box() != next || range.size() > std::max<size_t>(grain, 1))
+               std::cout << " ERROR - range [" << range.begin_box() << ", " << range.end_box() << ") after box " << next;
+             next = range.end_box();
+             range.for_each([&keys](const Key &k) { keys.push_back(k); });
+           }
+           if (next != whole.end_box())
+             std::cout << " ERROR - ranges end at box " << next << ", should be " << whole.end_box();
+           test_visited(keys, *r, "box_range");
+           break;
+         }
+         case Code::memory: {
+           unsigned seed, count {100000}, keep {100};
+           line_stream >> count >> keep;
+           if (line_stream >> seed) random.seed(seed);
+           {
+             counting_set m;
+             m.min_load_factor(0.2f);
+             std::vector<Key> keys;
+             size_t peak {0};
+             for (unsigned i {0}; i < count; ++i) {
+               keys.push_back(random.next<Key>());
+               m.insert(keys.back());
+               peak = std::max(peak, allocated_bytes);
+             }
+             size_t full {allocated_bytes};
+             for (size_t i {keep}; i < keys.size(); ++i) {
+               m.erase(keys[i]);
+               if (allocated_bytes > peak)
+                 std::cout << " ERROR - " << allocated_bytes << " bytes after erase, " << peak << " while inserting";
+               peak = std::max(peak, allocated_bytes);
+             }
+             size_t sparse {allocated_bytes};
+             m.shrink_to_fit();
+             std::cout << ' ' << full << ' ' << sparse << ' ' << allocated_bytes;
+             if (allocated_bytes > sparse)
+               std::cout << " ERROR - shrink_to_fit() grows from " << sparse << " to " << allocated_bytes << " bytes";
+             // the slabs are released if the keys can be moved into new ones without exceptions
+             if (std::is_nothrow_move_constructible_v<Key> && m.size() * 16 < count && allocated_bytes * 4 > full)
+               std::cout << " ERROR - " << allocated_bytes << " bytes for " << m.size() << " keys, " << full
+                 << " for " << count;
+           }
+           if (allocated_bytes)
+             std::cout << " ERROR - " << allocated_bytes << " bytes not released";
+           break;
+         }
+ #endif
          default:
            throw std::runtime_error("ERROR - unknown command code");
        }